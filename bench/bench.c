@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "workload.h"
+#include "lexer.h"
+#include "parser.h"
+#include "generator.h"
+
+#define DEFAULT_SIZE (32 * 1024 * 1024)
+#define DEFAULT_OUTPUT "bench_output.txt"
+#define SEED 0x6361726f // "caro"
+
+struct bench_result {
+	size_t bytes;
+	size_t tokens;
+	size_t nodes;
+	size_t ast_bytes;
+	size_t output_bytes;
+	double tokenize_time;
+	double parse_time;
+	double generate_time;
+	long peak_rss; // in KiB
+};
+
+double now() {
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+	
+}
+
+struct bench_result run_workload(enum workload kind, size_t size) {
+	
+	struct bench_result result = {0};
+	
+	struct buffer source = {0};
+	generate_workload(&source, kind, size, SEED);
+	buffer_append_char(&source, 0); // tokenize() needs the NUL after the last byte
+	result.bytes = source.size - 1;
+	
+	double start = now();
+	struct token* tokens = tokenize(source.data, result.bytes);
+	result.tokenize_time = now() - start;
+	while(tokens[result.tokens].type != TOKEN_END) result.tokens++;
+	
+	start = now();
+	struct ast* ast = parse(tokens, source.data);
+	result.parse_time = now() - start;
+	result.nodes = ast->node_count;
+	result.ast_bytes = ast_memory(ast);
+	
+	struct buffer code = {0};
+	start = now();
+	generate_c(ast, &code, LINKAGE_EXTERNAL);
+	result.generate_time = now() - start;
+	result.output_bytes = code.size;
+	
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result.peak_rss = usage.ru_maxrss;
+	
+	buffer_free(&code);
+	free_ast(ast);
+	free(tokens);
+	buffer_free(&source);
+	return result;
+	
+}
+
+int main(int argc, char** argv) {
+	
+	const char* output = DEFAULT_OUTPUT;
+	size_t size = DEFAULT_SIZE;
+	int only = -1;
+	
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp("-o", argv[i]) && i + 1 < argc) output = argv[++i];
+		else if(!strcmp("-s", argv[i]) && i + 1 < argc) size = strtoull(argv[++i], 0, 0);
+		else if(!strcmp("-w", argv[i]) && i + 1 < argc && (only = find_workload(argv[++i])) >= 0) continue;
+		else {
+			fprintf(stderr, "Usage: bench [-o file] [-s bytes] [-w workload]\n");
+			return 1;
+		}
+	}
+	
+	FILE* file = fopen(output, "w");
+	if(!file) {
+		fprintf(stderr, "E: Failed to open/create file \"%s\"!\n", output);
+		return 1;
+	}
+	
+	printf("%-12s %10s %12s %12s %12s %10s\n", "workload", "lex MB/s", "tokens/s", "parse MB/s", "nodes/s", "gen MB/s");
+	
+	for(int kind = 0; kind < WORKLOAD_COUNT; kind++) {
+		
+		if(only >= 0 && kind != only) continue;
+		
+		// every workload runs in its own process, so the peak RSS belongs to it alone
+		int fds[2];
+		if(pipe(fds)) return 1;
+		pid_t pid = fork();
+		if(pid < 0) return 1;
+		if(!pid) {
+			close(fds[0]);
+			struct bench_result result = run_workload(kind, size);
+			write(fds[1], &result, sizeof(result));
+			_exit(0);
+		}
+		close(fds[1]);
+		struct bench_result result;
+		ssize_t got = read(fds[0], &result, sizeof(result));
+		close(fds[0]);
+		int status;
+		waitpid(pid, &status, 0);
+		if(got != sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "E: Workload \"%s\" failed!\n", workload_names[kind]);
+			return 1;
+		}
+		
+		double mb = result.bytes / 1e6;
+		printf("%-12s %10.1f %12.0f %12.1f %12.0f %10.1f\n", workload_names[kind], mb / result.tokenize_time, result.tokens / result.tokenize_time, mb / result.parse_time, result.nodes / result.parse_time, result.output_bytes / 1e6 / result.generate_time);
+		
+		fprintf(file, "{\"workload\":\"%s\",\"bytes\":%zu,\"tokens\":%zu,\"nodes\":%zu,\"ast_bytes\":%zu,\"output_bytes\":%zu,"
+			"\"tokenize_seconds\":%.6f,\"parse_seconds\":%.6f,\"generate_seconds\":%.6f,"
+			"\"tokenize_mb_per_second\":%.3f,\"tokens_per_second\":%.0f,\"parse_mb_per_second\":%.3f,\"nodes_per_second\":%.0f,\"generate_mb_per_second\":%.3f,"
+			"\"peak_rss_kib\":%ld}\n",
+			workload_names[kind], result.bytes, result.tokens, result.nodes, result.ast_bytes, result.output_bytes,
+			result.tokenize_time, result.parse_time, result.generate_time,
+			mb / result.tokenize_time, result.tokens / result.tokenize_time, mb / result.parse_time, result.nodes / result.parse_time, result.output_bytes / 1e6 / result.generate_time,
+			result.peak_rss);
+		
+	}
+	
+	fclose(file);
+	return 0;
+	
+}
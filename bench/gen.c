@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "workload.h"
+
+int main(int argc, char** argv) { // writes a generated program to stdout, e.g. bench/gen nested 100000000 | ./caro -
+	
+	int kind;
+	if(argc < 3 || (kind = find_workload(argv[1])) < 0) {
+		fprintf(stderr, "Usage: gen workload bytes [seed]\n");
+		fprintf(stderr, "\tworkloads:");
+		for(int i = 0; i < WORKLOAD_COUNT; i++) fprintf(stderr, " %s", workload_names[i]);
+		fprintf(stderr, "\n");
+		return 1;
+	}
+	
+	struct buffer out = {0};
+	generate_workload(&out, kind, strtoull(argv[2], 0, 0), argc > 3 ? strtoull(argv[3], 0, 0) : 1);
+	if(buffer_write(&out, STDOUT_FILENO)) return 1;
+	buffer_free(&out);
+	return 0;
+	
+}
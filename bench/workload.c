@@ -0,0 +1,215 @@
+#include <string.h>
+#include "workload.h"
+
+#define MAX_EXPRESSION_DEPTH 24
+
+const char* workload_names[WORKLOAD_COUNT] = {"expressions", "nested", "identifiers", "comments", "mixed", "chain", "deep", "tables"};
+
+uint64_t next_random(uint64_t* state) { // xorshift64*, good enough and the same everywhere
+	
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1d;
+	
+}
+
+int find_workload(const char* name) {
+	
+	for(int i = 0; i < WORKLOAD_COUNT; i++) {
+		if(!strcmp(name, workload_names[i])) return i;
+	}
+	return -1;
+	
+}
+
+void append_literal(struct buffer* out, uint64_t* rng) {
+	
+	static const char hex[] = "0123456789abcdef";
+	uint64_t r = next_random(rng);
+	
+	if(r % 4 == 0) {
+		buffer_append_string(out, "0x");
+		for(int i = 0; i < 4; i++) buffer_append_char(out, hex[(r >> (8 + i * 4)) & 15]);
+	} else {
+		buffer_append_int(out, (r >> 8) % 100000);
+	}
+	
+}
+
+void append_divisor(struct buffer* out, uint64_t* rng) { // a literal that isn't 0, so the program stays valid
+	
+	buffer_append_int(out, 1 + (next_random(rng) >> 8) % 99999);
+	
+}
+
+void append_table_entry(struct buffer* out, uint64_t* rng) {
+	
+	static const char hex[] = "0123456789abcdef";
+	uint64_t r = next_random(rng);
+	int digits = 1 + r % 16; // of the value in hex, so every width shows up
+	uint64_t value = next_random(rng) >> (64 - digits * 4);
+	
+	if(r & 16) {
+		buffer_append_string(out, "0x");
+		for(int i = digits; i--;) buffer_append_char(out, hex[(value >> (i * 4)) & 15]);
+	} else {
+		buffer_append_unsigned(out, value);
+	}
+	
+}
+
+void append_identifier(struct buffer* out, uint64_t* rng) {
+	
+	static const char* words[] = {"value", "offset", "counter", "total", "index", "length", "accumulator", "temporary", "scale", "bias"};
+	uint64_t r = next_random(rng);
+	
+	buffer_append_string(out, words[r % 10]);
+	buffer_append_char(out, '_');
+	buffer_append_string(out, words[(r >> 8) % 10]);
+	buffer_append_char(out, '_');
+	buffer_append_int(out, (r >> 16) % 1000);
+	
+}
+
+void append_expression(struct buffer* out, uint64_t* rng, int depth) {
+	
+	static const char operators[] = "+-*/%";
+	uint64_t r = next_random(rng);
+	
+	if(depth >= MAX_EXPRESSION_DEPTH || r % 8 == 0) {
+		append_literal(out, rng);
+		return;
+	}
+	
+	char operator = operators[(r >> 8) % 5];
+	buffer_append_char(out, '(');
+	append_expression(out, rng, depth + 1);
+	buffer_append_char(out, ' ');
+	buffer_append_char(out, operator);
+	buffer_append_char(out, ' ');
+	if(operator == '/' || operator == '%') append_divisor(out, rng); // any expression could fold to 0
+	else append_expression(out, rng, depth + 1);
+	buffer_append_char(out, ')');
+	
+}
+
+void append_nested_function(struct buffer* out, uint64_t* rng, int depth, size_t id) {
+	
+	for(int i = 0; i < depth; i++) buffer_append_char(out, '\t');
+	buffer_append_string(out, "fn f");
+	buffer_append_int(out, id);
+	buffer_append_string(out, "() -> i32 {\n");
+	
+	if(depth < 6) {
+		size_t children = 1 + next_random(rng) % 3;
+		for(size_t i = 0; i < children; i++) append_nested_function(out, rng, depth + 1, i);
+	}
+	
+	for(int i = 0; i <= depth; i++) buffer_append_char(out, '\t');
+	buffer_append_string(out, "return ");
+	append_literal(out, rng);
+	buffer_append_string(out, " + ");
+	append_literal(out, rng);
+	buffer_append_string(out, ";\n");
+	
+	for(int i = 0; i < depth; i++) buffer_append_char(out, '\t');
+	buffer_append_string(out, "}\n");
+	
+}
+
+void append_function(struct buffer* out, enum workload kind, uint64_t* rng, size_t id) {
+	
+	switch(kind) {
+	case WORKLOAD_EXPRESSIONS:
+		buffer_append_string(out, "fn e");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> i32 {\n\treturn ");
+		append_expression(out, rng, 0);
+		buffer_append_string(out, ";\n}\n");
+		break;
+	case WORKLOAD_NESTED:
+		buffer_append_string(out, "fn n");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> i32 {\n");
+		append_nested_function(out, rng, 1, 0);
+		buffer_append_string(out, "\treturn 0;\n}\n");
+		break;
+	case WORKLOAD_IDENTIFIERS: { // nothing declares values, so the long names are the ones of nested functions
+		buffer_append_string(out, "fn names");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> i64 {\n");
+		size_t count = 16 + next_random(rng) % 48;
+		for(size_t i = 0; i < count; i++) {
+			buffer_append_string(out, "\tfn ");
+			append_identifier(out, rng);
+			buffer_append_char(out, '_');
+			buffer_append_int(out, i); // the names have to be unique in the scope
+			buffer_append_string(out, "() -> i64 { return ");
+			append_literal(out, rng);
+			buffer_append_string(out, "; }\n");
+		}
+		buffer_append_string(out, "\treturn 0;\n}\n");
+		break;
+	}
+	case WORKLOAD_COMMENTS:
+		buffer_append_string(out, "# ------------------------------------------------------------------------\n");
+		buffer_append_string(out, "# generated function, the comment is much longer than the code it describes\n");
+		buffer_append_string(out, "# ------------------------------------------------------------------------\n");
+		buffer_append_string(out, "fn c");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> i32 {\n\t\t\t\t# nothing to see here\n\t\t\t\treturn ");
+		append_literal(out, rng);
+		buffer_append_string(out, ";        # trailing comment\n}\n\n\n");
+		break;
+	case WORKLOAD_CHAIN:
+		buffer_append_string(out, "fn s");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> i32 {\n\treturn ");
+		for(size_t i = 0; i < STRESS_TERMS; i++) {
+			if(i) buffer_append_string(out, (next_random(rng) & 1) ? " + " : " - ");
+			append_literal(out, rng);
+		}
+		buffer_append_string(out, ";\n}\n");
+		break;
+	case WORKLOAD_DEEP:
+		buffer_append_string(out, "fn d");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> i32 {\n\treturn ");
+		for(size_t i = 1; i < STRESS_TERMS; i++) {
+			append_literal(out, rng);
+			buffer_append_string(out, " * (");
+		}
+		append_literal(out, rng);
+		for(size_t i = 1; i < STRESS_TERMS; i++) buffer_append_char(out, ')');
+		buffer_append_string(out, ";\n}\n");
+		break;
+	case WORKLOAD_TABLES:
+		buffer_append_string(out, "fn t");
+		buffer_append_int(out, id);
+		buffer_append_string(out, "() -> u64 {\n\treturn ");
+		for(size_t i = 0; i < 256; i++) {
+			if(i) buffer_append_string(out, i % 4 ? " + " : "\n\t\t+ ");
+			append_table_entry(out, rng);
+		}
+		buffer_append_string(out, ";\n}\n");
+		break;
+	default: {
+		enum workload picked = next_random(rng) % WORKLOAD_MIXED;
+		append_function(out, picked, rng, id);
+		break;
+	}
+	}
+	
+}
+
+void generate_workload(struct buffer* out, enum workload kind, size_t size, uint64_t seed) {
+	
+	uint64_t rng = seed ? seed : 1;
+	size_t start = out->size;
+	
+	for(size_t id = 0; out->size - start < size; id++) append_function(out, kind, &rng, id);
+	
+	buffer_append_string(out, "fn main() -> i32 {\n\treturn 0;\n}\n");
+	
+}
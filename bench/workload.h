@@ -0,0 +1,23 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "buffer.h"
+
+enum workload {
+	WORKLOAD_EXPRESSIONS, // deep, parenthesized arithmetic on literals
+	WORKLOAD_NESTED, // functions declared inside functions, several levels deep
+	WORKLOAD_IDENTIFIERS, // functions declaring many nested functions with long names
+	WORKLOAD_COMMENTS, // small functions buried in comments and indentation
+	WORKLOAD_MIXED, // all of the above, interleaved
+	WORKLOAD_CHAIN, // sums of STRESS_TERMS terms without parentheses
+	WORKLOAD_DEEP, // STRESS_TERMS terms, each one in another pair of parentheses
+	WORKLOAD_TABLES, // long sums of literals of up to 64 bits, like generated lookup tables
+	WORKLOAD_COUNT
+};
+
+#define STRESS_TERMS 1000000 // per function of the chain and deep workloads, they are left out of mixed
+
+extern const char* workload_names[WORKLOAD_COUNT];
+
+int find_workload(const char* name); // -1 if there's no such workload
+void generate_workload(struct buffer* out, enum workload kind, size_t size, uint64_t seed); // appends at least size bytes of Caro, the same for the same seed
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "buffer.h"
+#include "error.h"
+
+void buffer_reserve(struct buffer* buf, size_t size) {
+	
+	if(buf->capacity - buf->size >= size) return;
+	
+	size_t capacity = buf->capacity ? buf->capacity : 4096;
+	while(capacity - buf->size < size) capacity *= 2;
+	
+	char* data = realloc(buf->data, capacity);
+	if(!data) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	buf->data = data;
+	buf->capacity = capacity;
+	
+}
+
+void buffer_append(struct buffer* buf, const char* data, size_t size) {
+	
+	buffer_reserve(buf, size);
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	
+}
+
+void buffer_append_string(struct buffer* buf, const char* str) {
+	
+	buffer_append(buf, str, strlen(str));
+	
+}
+
+void buffer_append_char(struct buffer* buf, char ch) {
+	
+	if(buf->size == buf->capacity) buffer_reserve(buf, 1);
+	buf->data[buf->size++] = ch;
+	
+}
+
+void buffer_append_unsigned(struct buffer* buf, unsigned long num) {
+	
+	char digits[20];
+	int count = 0;
+	
+	do {
+		digits[count++] = '0' + num % 10;
+		num /= 10;
+	} while(num);
+	
+	buffer_reserve(buf, count);
+	while(count) buf->data[buf->size++] = digits[--count];
+	
+}
+
+void buffer_append_int(struct buffer* buf, long num) {
+	
+	if(num < 0) buffer_append_char(buf, '-');
+	buffer_append_unsigned(buf, num < 0 ? -(unsigned long)num : (unsigned long)num);
+	
+}
+
+int buffer_write(struct buffer* buf, int fd) {
+	
+	size_t written = 0;
+	while(written < buf->size) {
+		ssize_t ret = write(fd, buf->data + written, buf->size - written);
+		if(ret < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		written += ret;
+	}
+	return 0;
+	
+}
+
+void buffer_free(struct buffer* buf) {
+	
+	free(buf->data);
+	buf->data = 0;
+	buf->size = 0;
+	buf->capacity = 0;
+	
+}
+
+void buffer_cleanup(void* buf) {
+	
+	buffer_free(buf);
+	
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stddef.h>
+
+struct buffer { // growable byte buffer, the data isn't NUL-terminated
+	char* data;
+	size_t size;
+	size_t capacity;
+};
+
+void buffer_reserve(struct buffer* buf, size_t size); // makes room for at least size more bytes
+void buffer_append(struct buffer* buf, const char* data, size_t size);
+void buffer_append_string(struct buffer* buf, const char* str);
+void buffer_append_char(struct buffer* buf, char ch);
+void buffer_append_unsigned(struct buffer* buf, unsigned long num);
+void buffer_append_int(struct buffer* buf, long num);
+int buffer_write(struct buffer* buf, int fd); // writes the whole buffer, returns 0 on success
+void buffer_free(struct buffer* buf);
+void buffer_cleanup(void* buf); // buffer_free() for push_cleanup()
@@ -0,0 +1,586 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "build.h"
+#include "generator.h"
+#include "report.h"
+#include "error.h"
+
+#define GCC_FLAGS 8 // the most arguments add_gcc_flags() adds, including the NULL at the end
+
+extern char** environ;
+
+pid_t start_command(char* const argv[], int* input) {
+	
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	
+	int pipe_fds[2] = {-1, -1};
+	if(input) {
+		if(pipe(pipe_fds)) {
+			fprintf(stderr, "E: Failed to create a pipe!\n");
+			fail();
+		}
+		posix_spawn_file_actions_adddup2(&actions, pipe_fds[0], STDIN_FILENO);
+		posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+		posix_spawn_file_actions_addclose(&actions, pipe_fds[1]);
+	}
+	
+	pid_t pid;
+	int err = posix_spawnp(&pid, argv[0], &actions, 0, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if(input) close(pipe_fds[0]);
+	if(err) {
+		if(input) close(pipe_fds[1]);
+		fprintf(stderr, "E: Failed to run \"%s\"!\n", argv[0]);
+		fail();
+	}
+	if(input) *input = pipe_fds[1];
+	return pid;
+	
+}
+
+int wait_command(pid_t pid, const char* name) {
+	
+	int status;
+	while(waitpid(pid, &status, 0) < 0) {
+		if(errno != EINTR) {
+			fprintf(stderr, "E: Failed to wait for \"%s\"!\n", name);
+			fail();
+		}
+	}
+	
+	if(WIFEXITED(status)) return WEXITSTATUS(status);
+	return 128 + WTERMSIG(status);
+	
+}
+
+int run_command(char* const argv[], struct buffer* input) {
+	
+	int input_fd;
+	pid_t pid = start_command(argv, input ? &input_fd : 0);
+	
+	if(input) {
+		// if the child exits without reading everything, the write fails with EPIPE instead of killing us
+		void (*old_handler)(int) = signal(SIGPIPE, SIG_IGN);
+		buffer_write(input, input_fd);
+		close(input_fd);
+		signal(SIGPIPE, old_handler);
+	}
+	
+	return wait_command(pid, argv[0]);
+	
+}
+
+void write_file(const char* path, struct buffer* data) {
+	
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		fprintf(stderr, "E: Failed to open/create file \"%s\"!\n", path);
+		fail();
+	}
+	if(buffer_write(data, fd)) {
+		fprintf(stderr, "E: Failed to write to file \"%s\"!\n", path);
+		close(fd);
+		fail();
+	}
+	close(fd);
+	
+}
+
+void hash_compiler(struct sha256* ctx) {
+	
+	// stat()ing the binary is much cheaper than asking gcc for its version, and catches upgrades just as well
+	const char* path = getenv("PATH");
+	if(!path) path = "/usr/bin:/bin";
+	
+	while(*path) {
+		
+		const char* end = strchr(path, ':');
+		size_t len = end ? (size_t)(end - path) : strlen(path);
+		
+		char candidate[len + sizeof("/gcc")];
+		memcpy(candidate, path, len);
+		memcpy(candidate + len, "/gcc", sizeof("/gcc"));
+		
+		struct stat st;
+		if(len && !stat(candidate, &st) && S_ISREG(st.st_mode)) {
+			sha256_update(ctx, candidate, strlen(candidate) + 1);
+			sha256_update(ctx, &st.st_size, sizeof(st.st_size));
+			sha256_update(ctx, &st.st_mtim, sizeof(st.st_mtim));
+			return;
+		}
+		
+		path += len;
+		if(*path == ':') path++;
+		
+	}
+	
+}
+
+int optimized(const struct build_options* options) {
+	
+	return options->optimization && strcmp(options->optimization, "-O0");
+	
+}
+
+void hash_build_options(struct sha256* ctx, const struct build_options* options) {
+	
+	const char* flags[] = {options->optimization ? options->optimization : "", options->arch ? options->arch : ""};
+	for(int i = 0; i < 2; i++) sha256_update(ctx, flags[i], strlen(flags[i]) + 1);
+	int split = options->units > 1; // changes which functions the code keeps to itself, not how many units there are
+	sha256_update(ctx, &split, sizeof(split));
+	
+}
+
+// Returns the end of argv. unit names the profile of a translation unit, NULL when linking. Its profile is found by
+// that name alone, not by where the unit or the output are, so it stays valid for later builds elsewhere.
+char** add_gcc_flags(char** argv, const struct build_options* options, const char* unit) {
+	
+	if(options->optimization) *argv++ = (char*)options->optimization;
+	if(options->arch) *argv++ = (char*)options->arch;
+	if(options->profile) {
+		*argv++ = (char*)options->profile;
+		if(unit) {
+			*argv++ = "-dumpdir";
+			*argv++ = "/";
+			*argv++ = "-dumpbase";
+			*argv++ = (char*)unit;
+		}
+	}
+	*argv = 0;
+	return argv;
+	
+}
+
+struct partition { // the files of build_partitioned(), in a temporary directory
+	char* dir;
+	size_t units;
+	pid_t* compilers; // still running
+	size_t compiler_count;
+};
+
+void unit_path(char* out, size_t size, const struct partition* partition, size_t unit, char suffix) { // ".c" or ".o"
+	
+	snprintf(out, size, "%s/unit%zu.%c", partition->dir, unit, suffix);
+	
+}
+
+void free_partition(void* arg) { // fail() can leave compilers running, they must be done before their files go away
+	
+	struct partition* partition = arg;
+	for(size_t i = 0; i < partition->compiler_count; i++) waitpid(partition->compilers[i], 0, 0);
+	if(!partition->dir) return;
+	size_t size = strlen(partition->dir) + sizeof("/unit.c") + 20;
+	char file[size];
+	for(size_t i = 0; i < partition->units; i++) {
+		unit_path(file, size, partition, i, 'c');
+		unlink(file);
+		unit_path(file, size, partition, i, 'o');
+		unlink(file);
+	}
+	snprintf(file, size, "%s/caro.h", partition->dir);
+	unlink(file);
+	rmdir(partition->dir);
+	free(partition->dir);
+	
+}
+
+uint32_t statement_size(struct ast* ast, uint32_t node) { // in nodes, roughly what gcc's time depends on
+	
+	return ast->types[node] == FUNCTION_DECLARATION ? ast->functions[ast->lhs[node]].end - node : 1;
+	
+}
+
+// Compiles contiguous runs of top-level statements with about the same number of nodes each as units of their own,
+// all at the same time, and links them. The units share a header with the typedefs and the prototypes.
+void build_partitioned(struct ast* ast, const char* path, const struct build_options* options) {
+	
+	uint32_t* body = &ast->lists[ast->body];
+	size_t units = options->units < body[0] ? options->units : body[0];
+	if(units <= 1) { // nothing to split, an empty program would even leave no object to link
+		struct build_options single = *options;
+		single.units = 1;
+		build(ast, path, &single);
+		return;
+	}
+	
+	// without a handler of its own, fail() would exit right away and leave the temporary files behind
+	struct error_handler handler;
+	if(setjmp(handler.jump)) fail(); // the cleanups have run, on to the caller's handler
+	push_error_handler(&handler);
+	uint64_t total = 0;
+	for(uint32_t i = 1; i <= body[0]; i++) total += statement_size(ast, body[i]);
+	
+	const char* tmp = getenv("TMPDIR");
+	if(!tmp || !*tmp) tmp = "/tmp";
+	struct partition partition = {0};
+	pid_t compilers[units];
+	partition.compilers = compilers;
+	push_cleanup(free_partition, &partition);
+	size_t size = strlen(tmp) + sizeof("/caro.XXXXXX");
+	partition.dir = malloc(size);
+	if(!partition.dir) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	snprintf(partition.dir, size, "%s/caro.XXXXXX", tmp);
+	if(!mkdtemp(partition.dir)) {
+		fprintf(stderr, "E: Failed to create a temporary directory in \"%s\"!\n", tmp);
+		free(partition.dir);
+		partition.dir = 0;
+		fail();
+	}
+	size = strlen(partition.dir) + sizeof("/unit.c") + 20;
+	char files[units][size];
+	
+	struct buffer code = {0};
+	push_cleanup(buffer_cleanup, &code);
+	report_begin(PHASE_GENERATE);
+	enum linkage linkage = optimized(options) ? LINKAGE_OBJECT : LINKAGE_EXTERNAL;
+	if(options->preserve) { // one file for the user, the units are temporary
+		generate_c(ast, &code, linkage);
+		int length = snprintf(0, 0, "%s.c", path);
+		char p[length + 1];
+		snprintf(p, length + 1, "%s.c", path);
+		write_file(p, &code);
+		code.size = 0;
+	}
+	generate_c_header(ast, &code);
+	snprintf(files[0], size, "%s/caro.h", partition.dir);
+	write_file(files[0], &code);
+	
+	uint64_t done = 0;
+	code.size = 0;
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		if(!code.size) { // gcc checks a profile against the file names it sees, the temporary directory mustn't be one of them
+			buffer_append_string(&code, "#include \"caro.h\"\n#line 2 \"unit");
+			buffer_append_unsigned(&code, partition.units);
+			buffer_append_string(&code, ".c\"\n");
+		}
+		generate_c_statement(ast, body[i], &code, linkage);
+		done += statement_size(ast, body[i]);
+		if(i == body[0] || done * units >= total * (partition.units + 1)) { // a huge function can take the share of several units
+			buffer_append_char(&code, '\n');
+			unit_path(files[partition.units], size, &partition, partition.units, 'c');
+			partition.units++;
+			write_file(files[partition.units - 1], &code);
+			code.size = 0;
+		}
+	}
+	report_end(PHASE_GENERATE);
+	pop_cleanup(1); // code
+	
+	report_begin(PHASE_COMPILE);
+	for(size_t i = 0; i < partition.units; i++) {
+		char object[size];
+		unit_path(object, size, &partition, i, 'o');
+		char name[32];
+		snprintf(name, sizeof(name), "unit%zu", i);
+		char* argv[5 + GCC_FLAGS] = {"gcc", "-c", files[i], "-o", object};
+		add_gcc_flags(&argv[5], options, name);
+		compilers[partition.compiler_count] = start_command(argv, 0);
+		partition.compiler_count++;
+	}
+	int ret = 0;
+	while(partition.compiler_count) {
+		partition.compiler_count--;
+		if(wait_command(compilers[partition.compiler_count], "gcc")) ret = 1;
+	}
+	if(ret) fail(); // gcc has said why
+	
+	char* argv[3 + partition.units + GCC_FLAGS];
+	argv[0] = "gcc";
+	argv[1] = "-o";
+	argv[2] = (char*)path;
+	for(size_t i = 0; i < partition.units; i++) {
+		unit_path(files[i], size, &partition, i, 'o');
+		argv[3 + i] = files[i];
+	}
+	add_gcc_flags(&argv[3 + partition.units], options, 0);
+	ret = run_command(argv, 0);
+	report_end(PHASE_COMPILE);
+	pop_cleanup(1); // partition
+	pop_error_handler(&handler);
+	if(ret) fail();
+	
+}
+
+void build(struct ast* ast, const char* path, const struct build_options* options) {
+	
+	if(options->units > 1) {
+		build_partitioned(ast, path, options);
+		return;
+	}
+	
+	struct buffer code = {0};
+	push_cleanup(buffer_cleanup, &code);
+	report_begin(PHASE_GENERATE);
+	generate_c(ast, &code, optimized(options) ? LINKAGE_PROGRAM : LINKAGE_EXTERNAL);
+	
+	if(options->preserve) { // the code still goes to gcc through the pipe, this copy is only for the user
+		int size = snprintf(0, 0, "%s.c", path);
+		char p[size + 1];
+		snprintf(p, size + 1, "%s.c", path);
+		write_file(p, &code);
+	}
+	report_end(PHASE_GENERATE);
+	
+	report_begin(PHASE_COMPILE);
+	char* argv[6 + GCC_FLAGS] = {"gcc", "-x", "c", "-", "-o", (char*)path};
+	add_gcc_flags(&argv[6], options, "program");
+	int ret = run_command(argv, &code);
+	report_end(PHASE_COMPILE);
+	pop_cleanup(1);
+	if(ret) fail();
+	
+}
+
+struct pgo_training {
+	const char* path;
+	const char* profile;
+};
+
+void discard_training(void* arg) { // the instrumented binary and the partial profile are of no use to anyone
+	
+	struct pgo_training* training = arg;
+	unlink(training->path);
+	remove_directory(AT_FDCWD, training->profile);
+	
+}
+
+void build_pgo(struct ast* ast, const char* path, const struct build_options* options, const char* command, struct cache* cache, const char* key) {
+	
+	char* profiles_dir = cache_path(cache, "profiles");
+	struct cache profiles;
+	int ret = cache_init(&profiles, profiles_dir);
+	free(profiles_dir);
+	push_cleanup(cache_cleanup, &profiles);
+	if(ret) fail();
+	char* profile = cache_path(&profiles, key);
+	push_cleanup(free, profile);
+	
+	struct build_options pgo = *options;
+	size_t size = strlen(profile) + sizeof("-fprofile-generate=.tmp.") + 20;
+	char flag[size];
+	if(!cache_contains(&profiles, key)) { // the profile is a directory of .gcda files, marked as recently used here
+		
+		// trained into a directory of its own, concurrent compilations of the same program can't mix their counters
+		char tmp[size];
+		snprintf(tmp, size, "%s.tmp.%d", profile, (int)getpid());
+		remove_directory(AT_FDCWD, tmp); // left behind by an earlier process with the same pid
+		snprintf(flag, size, "-fprofile-generate=%s", tmp);
+		pgo.profile = flag;
+		
+		// without a handler of its own, fail() would exit right away and leave both behind
+		struct error_handler handler;
+		if(setjmp(handler.jump)) fail(); // the cleanups have run, on to the caller's handler
+		push_error_handler(&handler);
+		struct pgo_training training = {path, tmp};
+		push_cleanup(discard_training, &training);
+		build(ast, path, &pgo);
+		
+		report_begin(PHASE_RUN);
+		char* argv[] = {"/bin/sh", "-c", (char*)command, 0};
+		ret = run_command(argv, 0);
+		report_end(PHASE_RUN);
+		struct stat st;
+		if(stat(tmp, &st)) {
+			fprintf(stderr, "E: The training command didn't run \"%s\" (exit status %d), there's no profile!\n", path, ret);
+			fail();
+		}
+		if(rename(tmp, profile)) remove_directory(AT_FDCWD, tmp); // someone else stored a profile in the meantime, that one is just as good
+		pop_cleanup(0); // training, the binary is rebuilt over below
+		pop_error_handler(&handler);
+		cache_evict(&profiles);
+		
+	}
+	
+	snprintf(flag, size, "-fprofile-use=%s", profile);
+	pgo.profile = flag;
+	build(ast, path, &pgo);
+	pop_cleanup(1); // profile
+	pop_cleanup(1); // profiles
+	
+}
+
+void hash_statement(struct sha256* ctx, struct ast* ast, uint32_t stmt, struct buffer* stack) {
+	
+	// expressions are hashed in preorder with an explicit stack, which doesn't grow the native one;
+	// node indices depend on everything before the statement, so only what they refer to goes into the hash
+	size_t base = stack->size;
+	buffer_append(stack, (const char*)&stmt, sizeof(stmt));
+	
+	while(stack->size > base) {
+		
+		stack->size -= sizeof(stmt);
+		memcpy(&stmt, stack->data + stack->size, sizeof(stmt));
+		enum ast_node_type type = ast->types[stmt];
+		sha256_update(ctx, &type, sizeof(type));
+		
+		switch(type) {
+		case NUMERIC_LITERAL: {
+			uint64_t value = literal_value(ast, stmt);
+			enum literal_width width = ast->operators[stmt];
+			sha256_update(ctx, &value, sizeof(value));
+			sha256_update(ctx, &width, sizeof(width));
+			break;
+		}
+		case IDENTIFIER:
+			sha256_update(ctx, ast->strings + ast->lhs[stmt], strlen(ast->strings + ast->lhs[stmt]) + 1);
+			break;
+		case BINARY_EXPRESSION: {
+			enum binary_operation operator = ast->operators[stmt];
+			sha256_update(ctx, &operator, sizeof(operator));
+			buffer_append(stack, (const char*)&ast->rhs[stmt], sizeof(stmt));
+			buffer_append(stack, (const char*)&ast->lhs[stmt], sizeof(stmt)); // popped first
+			break;
+		}
+		case FUNCTION_DECLARATION: {
+			struct function* function = &ast->functions[ast->lhs[stmt]];
+			const char* name = ast->strings + function->symbol;
+			const char* return_type = ast->strings + function->return_type;
+			sha256_update(ctx, name, strlen(name) + 1);
+			sha256_update(ctx, return_type, strlen(return_type) + 1);
+			uint32_t* body = &ast->lists[function->body];
+			for(uint32_t i = 1; i <= body[0]; i++) hash_statement(ctx, ast, body[i], stack);
+			size_t count = body[0];
+			sha256_update(ctx, &count, sizeof(count)); // keeps the end of the body apart from whatever follows
+			break;
+		}
+		case RETURN_STATEMENT: {
+			uint32_t value = ast->lhs[stmt];
+			char has_value = value != NO_NODE;
+			sha256_update(ctx, &has_value, 1);
+			if(has_value) buffer_append(stack, (const char*)&value, sizeof(value));
+			break;
+		}
+		default:
+			break;
+		}
+		
+	}
+	
+}
+
+void append_quoted(struct buffer* buf, const char* str) { // quoting for gcc response files
+	
+	buffer_append_char(buf, '"');
+	for(; *str; str++) {
+		if(*str == '"' || *str == '\\') buffer_append_char(buf, '\\');
+		buffer_append_char(buf, *str);
+	}
+	buffer_append_string(buf, "\"\n");
+	
+}
+
+void build_incremental(struct ast* ast, const char* path, const struct build_options* options, struct cache* cache) {
+	
+	char* objects_dir = cache_path(cache, "objects");
+	struct cache objects;
+	int ret = cache_init(&objects, objects_dir);
+	free(objects_dir);
+	push_cleanup(cache_cleanup, &objects);
+	if(ret) fail();
+	
+	// the object list goes through a response file, a big module has too many functions for the command line
+	struct buffer link_args = {0};
+	struct buffer code = {0};
+	struct buffer stack = {0}; // for hash_statement()
+	push_cleanup(buffer_cleanup, &link_args);
+	push_cleanup(buffer_cleanup, &code);
+	push_cleanup(buffer_cleanup, &stack);
+	
+	enum linkage linkage = optimized(options) ? LINKAGE_OBJECT : LINKAGE_EXTERNAL;
+	if(options->preserve) {
+		report_begin(PHASE_GENERATE);
+		generate_c(ast, &code, linkage);
+		int size = snprintf(0, 0, "%s.c", path);
+		char p[size + 1];
+		snprintf(p, size + 1, "%s.c", path);
+		write_file(p, &code);
+		report_end(PHASE_GENERATE);
+	}
+	
+	uint32_t* body = &ast->lists[ast->body];
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		
+		// nested functions are part of the fingerprint, they are emitted into the same object file
+		struct sha256 ctx;
+		sha256_init(&ctx);
+		sha256_update(&ctx, "caro " CARO_VERSION, sizeof("caro " CARO_VERSION));
+		hash_compiler(&ctx);
+		hash_build_options(&ctx, options);
+		hash_statement(&ctx, ast, body[i], &stack);
+		unsigned char digest[SHA256_SIZE];
+		char key[2 * SHA256_SIZE + 1];
+		sha256_final(&ctx, digest);
+		sha256_hex(digest, key);
+		
+		char* object = cache_path(&objects, key);
+		
+		if(!cache_contains(&objects, key)) {
+			
+			report_begin(PHASE_GENERATE);
+			code.size = 0;
+			generate_c_prelude(&code);
+			generate_c_statement(ast, body[i], &code, linkage);
+			report_end(PHASE_GENERATE);
+			
+			int size = snprintf(0, 0, "%s.tmp.%d", object, (int)getpid());
+			char tmp[size + 1];
+			snprintf(tmp, size + 1, "%s.tmp.%d", object, (int)getpid());
+			
+			char* argv[7 + GCC_FLAGS] = {"gcc", "-x", "c", "-", "-c", "-o", tmp};
+			add_gcc_flags(&argv[7], options, 0);
+			report_begin(PHASE_COMPILE);
+			ret = run_command(argv, &code);
+			report_end(PHASE_COMPILE);
+			if(ret) {
+				unlink(tmp);
+				free(object);
+				fail();
+			}
+			if(rename(tmp, object)) {
+				fprintf(stderr, "E: Failed to store object file \"%s\"!\n", object);
+				unlink(tmp);
+				free(object);
+				fail();
+			}
+			
+		}
+		
+		append_quoted(&link_args, object);
+		free(object);
+		
+	}
+	pop_cleanup(1); // stack
+	pop_cleanup(1); // code
+	
+	int size = snprintf(0, 0, "%s/link.%d", objects.dir, (int)getpid());
+	char response_file[size + 1];
+	snprintf(response_file, size + 1, "%s/link.%d", objects.dir, (int)getpid());
+	write_file(response_file, &link_args);
+	pop_cleanup(1); // link_args
+	
+	char response_arg[size + 2];
+	snprintf(response_arg, size + 2, "@%s", response_file);
+	char* argv[4 + GCC_FLAGS] = {"gcc", "-o", (char*)path, response_arg};
+	add_gcc_flags(&argv[4], options, 0);
+	report_begin(PHASE_COMPILE);
+	ret = run_command(argv, 0);
+	report_end(PHASE_COMPILE);
+	unlink(response_file);
+	
+	cache_evict(&objects);
+	pop_cleanup(1); // objects
+	if(ret) fail();
+	
+}
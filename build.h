@@ -0,0 +1,25 @@
+#pragma once
+#include "parser.h"
+#include "buffer.h"
+#include "sha256.h"
+#include "cache.h"
+
+#define CARO_VERSION "0.1.0"
+
+int run_command(char* const argv[], struct buffer* input); // runs argv without a shell, feeding input to its stdin if not NULL, returns the exit status
+void hash_compiler(struct sha256* ctx); // identifies the installed gcc, so cached builds are redone after it changes
+struct build_options {
+	int preserve; // also write the generated C code to "<path>.c"
+	const char* optimization; // passed on to gcc, e.g. "-O2"; NULL for gcc's default
+	const char* arch; // passed on to gcc, e.g. "-march=native"; NULL for gcc's default
+	size_t units; // build() splits the program into that many translation units and compiles them in parallel if it's more than one
+	const char* profile; // "-fprofile-generate=dir" or "-fprofile-use=dir" for a profile of the program, NULL for none
+};
+
+int optimized(const struct build_options* options); // whether the generated code should help gcc with optimizing
+void hash_build_options(struct sha256* ctx, const struct build_options* options);
+void build(struct ast* ast, const char* path, const struct build_options* options);
+// Builds the program instrumented, lets command train it and builds it again with the profile. The profile is kept in
+// the cache under key, which should stand for the program and the options, and later builds only do the last step.
+void build_pgo(struct ast* ast, const char* path, const struct build_options* options, const char* command, struct cache* cache, const char* key);
+void build_incremental(struct ast* ast, const char* path, const struct build_options* options, struct cache* cache); // compiles every top-level function into its own cached object file
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "error.h"
+
+struct cache_entry {
+	char name[2 * SHA256_SIZE + 1];
+	int directory; // of files that make up one entry, like a profile
+	size_t size;
+	struct timespec mtime;
+};
+
+char* path_join(const char* dir, const char* name) {
+	
+	size_t size = strlen(dir) + 1 + strlen(name) + 1;
+	char* path = malloc(size);
+	if(!path) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	snprintf(path, size, "%s/%s", dir, name);
+	return path;
+	
+}
+
+char* default_cache_dir() {
+	
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	if(xdg && *xdg) return path_join(xdg, "caro");
+	
+	const char* home = getenv("HOME");
+	if(home && *home) return path_join(home, ".cache/caro");
+	
+	return 0;
+	
+}
+
+int make_dirs(char* path) { // mkdir -p
+	
+	for(char* p = path + 1; *p; p++) {
+		if(*p != '/') continue;
+		*p = 0;
+		int ret = mkdir(path, 0755);
+		*p = '/';
+		if(ret && errno != EEXIST) return -1;
+	}
+	if(mkdir(path, 0755) && errno != EEXIST) return -1;
+	return 0;
+	
+}
+
+int cache_init(struct cache* cache, const char* dir) {
+	
+	cache->dir = strdup(dir);
+	cache->max_size = CACHE_MAX_SIZE;
+	if(!cache->dir) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	
+	if(make_dirs(cache->dir)) {
+		fprintf(stderr, "W: Failed to create cache directory \"%s\", compiling without cache!\n", cache->dir);
+		return -1;
+	}
+	return 0;
+	
+}
+
+int copy_fd(int in, int out) {
+	
+	while(1) {
+		ssize_t ret = copy_file_range(in, 0, out, 0, 1 << 30, 0);
+		if(ret > 0) continue;
+		if(!ret) return 0;
+		if(errno == EINTR) continue;
+		if(errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) return -1;
+		break; // not supported between these files, fall back to plain reads and writes
+	}
+	
+	char block[64 * 1024];
+	while(1) {
+		ssize_t ret = read(in, block, sizeof(block));
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret < 0) return -1;
+		if(!ret) return 0;
+		for(ssize_t written = 0; written < ret;) {
+			ssize_t w = write(out, block + written, ret - written);
+			if(w < 0 && errno == EINTR) continue;
+			if(w < 0) return -1;
+			written += w;
+		}
+	}
+	
+}
+
+int copy_file(const char* from, const char* to) { // goes through a temporary file, so readers never see a partial copy
+	
+	int in = open(from, O_RDONLY);
+	if(in < 0) return -1;
+	
+	size_t size = snprintf(0, 0, "%s.tmp.%d", to, (int)getpid());
+	char tmp[size + 1];
+	snprintf(tmp, size + 1, "%s.tmp.%d", to, (int)getpid());
+	
+	int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	if(out < 0) {
+		close(in);
+		return -1;
+	}
+	
+	int ret = copy_fd(in, out);
+	close(in);
+	if(close(out)) ret = -1;
+	if(!ret) ret = rename(tmp, to);
+	if(ret) unlink(tmp);
+	return ret;
+	
+}
+
+char* cache_path(struct cache* cache, const char* key) {
+	
+	return path_join(cache->dir, key);
+	
+}
+
+int cache_contains(struct cache* cache, const char* key) {
+	
+	char* path = path_join(cache->dir, key);
+	int hit = !utimensat(AT_FDCWD, path, 0, 0);
+	free(path);
+	return hit;
+	
+}
+
+int cache_fetch(struct cache* cache, const char* key, const char* output) {
+	
+	char* path = path_join(cache->dir, key);
+	int hit = !copy_file(path, output);
+	if(hit) utimensat(AT_FDCWD, path, 0, 0); // mark it as recently used for eviction
+	free(path);
+	return hit;
+	
+}
+
+int compare_entries(const void* a, const void* b) {
+	
+	const struct cache_entry* x = a;
+	const struct cache_entry* y = b;
+	if(x->mtime.tv_sec != y->mtime.tv_sec) return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+	if(x->mtime.tv_nsec != y->mtime.tv_nsec) return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+	return strcmp(x->name, y->name);
+	
+}
+
+int is_cache_key(const char* name) {
+	
+	if(strlen(name) != 2 * SHA256_SIZE) return 0;
+	for(int i = 0; name[i]; i++) {
+		if(!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f'))) return 0;
+	}
+	return 1;
+	
+}
+
+// A "<key>.tmp.<pid>" file or directory whose process is gone, a compile or a training run that was killed
+// before it could rename or remove it. A pid that was reused keeps it around until that process is gone too.
+int is_orphaned_temporary(const char* name) {
+	
+	if(strlen(name) <= 2 * SHA256_SIZE + sizeof(".tmp.") - 1) return 0;
+	char key[2 * SHA256_SIZE + 1];
+	memcpy(key, name, 2 * SHA256_SIZE);
+	key[2 * SHA256_SIZE] = 0;
+	if(!is_cache_key(key) || strncmp(&name[2 * SHA256_SIZE], ".tmp.", 5)) return 0;
+	char* end;
+	long pid = strtol(&name[2 * SHA256_SIZE + 5], &end, 10);
+	if(*end || pid <= 0 || pid == getpid()) return 0;
+	return kill(pid, 0) && errno == ESRCH;
+	
+}
+
+size_t directory_size(int parent, const char* name) { // of the regular files in it
+	
+	int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) return 0;
+	DIR* dir = fdopendir(fd);
+	if(!dir) {
+		close(fd);
+		return 0;
+	}
+	size_t size = 0;
+	struct dirent* ent;
+	while((ent = readdir(dir))) {
+		struct stat st;
+		if(!fstatat(dirfd(dir), ent->d_name, &st, 0) && S_ISREG(st.st_mode)) size += st.st_size;
+	}
+	closedir(dir);
+	return size;
+	
+}
+
+int remove_directory(int parent, const char* name) {
+	
+	int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) return -1;
+	DIR* dir = fdopendir(fd);
+	if(!dir) {
+		close(fd);
+		return -1;
+	}
+	struct dirent* ent;
+	while((ent = readdir(dir))) {
+		if(strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) unlinkat(dirfd(dir), ent->d_name, 0);
+	}
+	closedir(dir);
+	return unlinkat(parent, name, AT_REMOVEDIR);
+	
+}
+
+void cache_evict(struct cache* cache) {
+	
+	DIR* dir = opendir(cache->dir);
+	if(!dir) return;
+	
+	struct cache_entry* entries = 0;
+	size_t count = 0, capacity = 0, total = 0;
+	
+	struct dirent* ent;
+	while((ent = readdir(dir))) {
+		
+		struct stat st;
+		if(!is_cache_key(ent->d_name)) { // also skips temporary files of concurrent compiles
+			if(is_orphaned_temporary(ent->d_name) && !fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+				if(S_ISDIR(st.st_mode)) remove_directory(dirfd(dir), ent->d_name);
+				else unlinkat(dirfd(dir), ent->d_name, 0);
+			}
+			continue;
+		}
+		
+		if(fstatat(dirfd(dir), ent->d_name, &st, 0) || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) continue;
+		
+		if(count == capacity) {
+			size_t grown = capacity ? capacity * 2 : 64;
+			struct cache_entry* data = realloc(entries, grown * sizeof(struct cache_entry));
+			if(!data) {
+				free(entries);
+				closedir(dir);
+				fprintf(stderr, "E: Failed to allocate memory!\n");
+				fail();
+			}
+			entries = data;
+			capacity = grown;
+		}
+		memcpy(entries[count].name, ent->d_name, sizeof(entries[count].name));
+		entries[count].directory = S_ISDIR(st.st_mode);
+		entries[count].size = entries[count].directory ? directory_size(dirfd(dir), ent->d_name) : (size_t)st.st_size;
+		entries[count].mtime = st.st_mtim;
+		total += entries[count].size;
+		count++;
+		
+	}
+	
+	if(total > cache->max_size) {
+		qsort(entries, count, sizeof(struct cache_entry), compare_entries); // oldest first
+		for(size_t i = 0; i < count && total > cache->max_size; i++) {
+			int ret = entries[i].directory ? remove_directory(dirfd(dir), entries[i].name) : unlinkat(dirfd(dir), entries[i].name, 0);
+			if(!ret || errno == ENOENT) total -= entries[i].size;
+		}
+	}
+	
+	closedir(dir);
+	free(entries);
+	
+}
+
+void cache_store(struct cache* cache, const char* key, const char* path) {
+	
+	char* entry = path_join(cache->dir, key);
+	if(copy_file(path, entry)) fprintf(stderr, "W: Failed to store \"%s\" in the cache!\n", path);
+	free(entry);
+	
+	cache_evict(cache);
+	
+}
+
+void cache_free(struct cache* cache) {
+	
+	free(cache->dir);
+	cache->dir = 0;
+	
+}
+
+void cache_cleanup(void* cache) {
+	
+	cache_free(cache);
+	
+}
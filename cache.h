@@ -0,0 +1,23 @@
+#pragma once
+#include <stddef.h>
+#include "sha256.h"
+
+#define CACHE_MAX_SIZE ((size_t)512 * 1024 * 1024) // least recently used entries are evicted above this
+
+struct cache {
+	char* dir;
+	size_t max_size;
+};
+
+char* default_cache_dir(); // $XDG_CACHE_HOME/caro or ~/.cache/caro, NULL if neither is known
+int cache_init(struct cache* cache, const char* dir); // creates the directory if needed, returns 0 on success
+int cache_fetch(struct cache* cache, const char* key, const char* output); // copies the entry to output, returns 1 on a hit
+void cache_store(struct cache* cache, const char* key, const char* path); // copies path into the cache and evicts old entries
+char* cache_path(struct cache* cache, const char* key); // where the entry for key lives, has to be freed
+int cache_contains(struct cache* cache, const char* key); // also marks the entry as recently used
+// Removes least recently used entries until the cache fits into max_size. An entry is a file, or a directory of files
+// that its user put there under the key, like a profile.
+void cache_evict(struct cache* cache);
+int remove_directory(int parent, const char* name); // with the files in it, name is relative to the directory fd parent
+void cache_free(struct cache* cache);
+void cache_cleanup(void* cache); // cache_free() for push_cleanup()
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "error.h"
+
+#define MAX_CLEANUPS 64
+
+struct cleanup {
+	void (*fn)(void*);
+	void* arg;
+};
+
+_Thread_local struct error_handler* error_handler;
+_Thread_local struct cleanup cleanups[MAX_CLEANUPS];
+_Thread_local size_t cleanup_count;
+
+void push_error_handler(struct error_handler* handler) {
+	
+	handler->prev = error_handler;
+	handler->cleanup_depth = cleanup_count;
+	error_handler = handler;
+	
+}
+
+void pop_error_handler(struct error_handler* handler) {
+	
+	error_handler = handler->prev;
+	
+}
+
+void push_cleanup(void (*fn)(void*), void* arg) {
+	
+	if(cleanup_count == MAX_CLEANUPS) {
+		fprintf(stderr, "E: Too many nested cleanups!\n");
+		abort();
+	}
+	cleanups[cleanup_count].fn = fn;
+	cleanups[cleanup_count].arg = arg;
+	cleanup_count++;
+	
+}
+
+void pop_cleanup(int run) {
+	
+	cleanup_count--;
+	if(run) cleanups[cleanup_count].fn(cleanups[cleanup_count].arg);
+	
+}
+
+_Noreturn void fail() {
+	
+	struct error_handler* handler = error_handler;
+	if(!handler) exit(1); // nobody to return to, the process exit cleans up
+	
+	while(cleanup_count > handler->cleanup_depth) pop_cleanup(1);
+	error_handler = handler->prev;
+	longjmp(handler->jump, 1);
+	
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <setjmp.h>
+#include <stddef.h>
+
+// fail() is how every error path gives up on a compilation. Without an error handler it exits,
+// with one it runs the cleanups registered since the handler was pushed and jumps back to it.
+// Handlers and cleanups are per thread.
+
+struct error_handler {
+	jmp_buf jump;
+	struct error_handler* prev;
+	size_t cleanup_depth;
+};
+
+void push_error_handler(struct error_handler* handler); // call after setjmp(handler->jump) returned 0
+void pop_error_handler(struct error_handler* handler);
+void push_cleanup(void (*fn)(void*), void* arg);
+void pop_cleanup(int run); // removes the most recent cleanup, and runs it if run is set
+_Noreturn void fail();
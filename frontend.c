@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "frontend.h"
+#include "lexer.h"
+#include "module.h"
+#include "error.h"
+
+#define MIN_CHUNK_SIZE (1 << 20) // bytes, smaller chunks aren't worth a thread
+
+struct file_job {
+	struct source_file* files;
+	size_t count;
+	size_t next; // index of the next file nobody has taken yet
+	void (*work)(struct source_file* file);
+};
+
+void run_file_job(struct file_job* job, struct source_file* file) {
+	
+	// errors only mark the file, the other workers keep going and run_on_files() fails once they are done
+	struct error_handler handler;
+	if(setjmp(handler.jump)) {
+		file->failed = 1;
+		return;
+	}
+	push_error_handler(&handler);
+	job->work(file);
+	pop_error_handler(&handler);
+	
+}
+
+void* file_worker(void* arg) {
+	
+	struct file_job* job = arg;
+	size_t i;
+	while((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+		if(!job->files[i].failed) run_file_job(job, &job->files[i]);
+	}
+	return 0;
+	
+}
+
+void run_on_files(struct source_file* files, size_t count, void (*work)(struct source_file* file)) {
+	
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t thread_count = cpus > 0 ? cpus : 1;
+	if(thread_count > count) thread_count = count;
+	
+	struct file_job job = {files, count, 0, work};
+	if(thread_count <= 1) {
+		file_worker(&job);
+	} else {
+		pthread_t threads[thread_count - 1];
+		size_t started = 0;
+		for(; started < thread_count - 1; started++) {
+			if(pthread_create(&threads[started], 0, file_worker, &job)) break; // the remaining threads pick up the slack
+		}
+		file_worker(&job);
+		for(size_t i = 0; i < started; i++) pthread_join(threads[i], 0);
+	}
+	
+	for(size_t i = 0; i < count; i++) {
+		if(files[i].failed) fail();
+	}
+	
+}
+
+struct lexer_chunk {
+	const char* source;
+	size_t start;
+	size_t end;
+	size_t newlines;
+	int line; // of start, the sum of the newlines of the chunks before it plus one
+	struct token* tokens;
+	size_t token_count;
+	struct token* out; // where the tokens go in the stitched stream
+	int failed;
+};
+
+struct chunk_job {
+	struct lexer_chunk* chunks;
+	size_t count;
+	size_t next;
+	void (*work)(struct lexer_chunk* chunk);
+};
+
+void* chunk_worker(void* arg) { // like file_worker()
+	
+	struct chunk_job* job = arg;
+	size_t i;
+	while((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+		struct lexer_chunk* chunk = &job->chunks[i];
+		struct error_handler handler;
+		if(setjmp(handler.jump)) {
+			chunk->failed = 1;
+			continue;
+		}
+		push_error_handler(&handler);
+		job->work(chunk);
+		pop_error_handler(&handler);
+	}
+	return 0;
+	
+}
+
+// Returns the first chunk in source order that failed, or NULL, whichever thread got to its error first.
+struct lexer_chunk* run_on_chunks(struct lexer_chunk* chunks, size_t count, void (*work)(struct lexer_chunk* chunk)) {
+	
+	struct chunk_job job = {chunks, count, 0, work};
+	if(count <= 1) {
+		chunk_worker(&job);
+	} else {
+		pthread_t threads[count - 1];
+		size_t started = 0;
+		for(; started < count - 1; started++) {
+			if(pthread_create(&threads[started], 0, chunk_worker, &job)) break;
+		}
+		chunk_worker(&job);
+		for(size_t i = 0; i < started; i++) pthread_join(threads[i], 0);
+	}
+	
+	for(size_t i = 0; i < count; i++) {
+		if(chunks[i].failed) return &chunks[i];
+	}
+	return 0;
+	
+}
+
+void count_newlines(struct lexer_chunk* chunk) {
+	
+	const char* p = &chunk->source[chunk->start];
+	const char* end = &chunk->source[chunk->end];
+	while((p = memchr(p, '\n', end - p))) {
+		chunk->newlines++;
+		p++;
+	}
+	
+}
+
+void lex_chunk(struct lexer_chunk* chunk) { // errors fail without a message, they are reported by report_chunk()
+	
+	chunk->tokens = tokenize_range(chunk->source, chunk->start, chunk->end, chunk->line, &chunk->token_count, 1);
+	
+}
+
+_Noreturn void report_chunk(struct lexer_chunk* chunk) { // lexes a failed chunk again to print its first error, like tokenize() would
+	
+	size_t count;
+	free(tokenize_range(chunk->source, chunk->start, chunk->end, chunk->line, &count, 0));
+	fprintf(stderr, "E: Failed to allocate memory!\n"); // the only error that can go away
+	fail();
+	
+}
+
+void stitch_chunk(struct lexer_chunk* chunk) {
+	
+	if(chunk->token_count) memcpy(chunk->out, chunk->tokens, chunk->token_count * sizeof(struct token));
+	free(chunk->tokens);
+	chunk->tokens = 0;
+	
+}
+
+struct chunked_lexing {
+	struct lexer_chunk* chunks;
+	size_t count;
+};
+
+void free_chunked_lexing(void* arg) {
+	
+	struct chunked_lexing* lexing = arg;
+	for(size_t i = 0; i < lexing->count; i++) free(lexing->chunks[i].tokens);
+	free(lexing->chunks);
+	
+}
+
+struct token* tokenize_parallel(const char* source, size_t size, size_t threads) {
+	
+	struct chunked_lexing lexing = {calloc(threads, sizeof(struct lexer_chunk)), 0};
+	if(!lexing.chunks) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	push_cleanup(free_chunked_lexing, &lexing);
+	
+	// chunks of about the same size, unless a boundary is far from where it should be or a chunk would be empty
+	size_t start = 0;
+	for(size_t i = 1; i <= threads && start < size; i++) {
+		size_t end = i == threads ? size : size / threads * i;
+		if(end <= start) continue;
+		end = chunk_boundary(source, size, end);
+		struct lexer_chunk* chunk = &lexing.chunks[lexing.count++];
+		chunk->source = source;
+		chunk->start = start;
+		chunk->end = end;
+		start = end;
+	}
+	
+	// lines are counted first, so every chunk starts with its right line number and reports errors with it
+	if(run_on_chunks(lexing.chunks, lexing.count, count_newlines)) fail();
+	int line = 1;
+	for(size_t i = 0; i < lexing.count; i++) {
+		lexing.chunks[i].line = line;
+		line += lexing.chunks[i].newlines;
+	}
+	struct lexer_chunk* failed = run_on_chunks(lexing.chunks, lexing.count, lex_chunk);
+	if(failed) report_chunk(failed);
+	
+	size_t token_count = 0;
+	for(size_t i = 0; i < lexing.count; i++) token_count += lexing.chunks[i].token_count;
+	struct token* tokens = realloc(lexing.chunks[0].tokens, (token_count + 1) * sizeof(struct token)); // the first chunk's tokens are in place already
+	if(!tokens) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	lexing.chunks[0].tokens = 0;
+	struct token* out = tokens;
+	for(size_t i = 0; i < lexing.count; i++) {
+		lexing.chunks[i].out = out;
+		out += lexing.chunks[i].token_count;
+	}
+	lexing.chunks[0].token_count = 0;
+	if(run_on_chunks(lexing.chunks, lexing.count, stitch_chunk)) fail();
+	out->type = TOKEN_END;
+	out->kind = 0;
+	out->line = line;
+	out->length = 0;
+	out->offset = size;
+	
+	pop_cleanup(1);
+	return tokens;
+	
+}
+
+void tokenize_file(struct source_file* file) {
+	
+	if(is_module(&file->source)) {
+		file->module = 1;
+		return;
+	}
+	size_t threads = file->lexer_threads;
+	if(threads > file->source.size / MIN_CHUNK_SIZE) threads = file->source.size / MIN_CHUNK_SIZE;
+	if(threads > 1) {
+		file->tokens = tokenize_parallel(file->source.data, file->source.size, threads);
+	} else {
+		file->tokens = tokenize(file->source.data, file->source.size);
+	}
+	while(file->tokens[file->token_count].type != TOKEN_END) file->token_count++;
+	
+}
+
+void parse_file(struct source_file* file) {
+	
+	if(file->module) file->ast = load_module(&file->source, file->path);
+	else file->ast = parse(file->tokens, file->source.data);
+	
+}
+
+void tokenize_files(struct source_file* files, size_t count) {
+	
+	// the cores the pool leaves idle lex large files in chunks
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = cpus > (long)count ? cpus / count : 1;
+	for(size_t i = 0; i < count; i++) files[i].lexer_threads = threads;
+	run_on_files(files, count, tokenize_file);
+	
+}
+
+void parse_files(struct source_file* files, size_t count) {
+	
+	run_on_files(files, count, parse_file);
+	
+}
+
+uint64_t hash_name(const char* name) { // FNV-1a
+	
+	uint64_t hash = 0xcbf29ce484222325;
+	for(; *name; name++) hash = (hash ^ (unsigned char)*name) * 0x100000001b3;
+	return hash;
+	
+}
+
+struct defined_function {
+	const char* name;
+	size_t file;
+};
+
+void* allocate_merged(size_t count, size_t size) {
+	
+	void* data = malloc(count ? count * size : 1);
+	if(!data) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	return data;
+	
+}
+
+struct ast* merge_files(struct source_file* files, size_t count) {
+	
+	size_t function_count = 0;
+	for(size_t i = 0; i < count; i++) {
+		struct ast* ast = files[i].ast;
+		uint32_t* body = &ast->lists[ast->body];
+		for(uint32_t j = 1; j <= body[0]; j++) {
+			if(ast->types[body[j]] == FUNCTION_DECLARATION) function_count++;
+		}
+	}
+	
+	// open addressing table of top-level names, at most half full; files are visited in input order,
+	// so the first definition and every later duplicate are always reported the same way
+	size_t table_size = 16;
+	while(table_size < function_count * 2) table_size *= 2;
+	struct defined_function* table = calloc(table_size, sizeof(struct defined_function));
+	if(!table) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	
+	int duplicates = 0;
+	for(size_t i = 0; i < count; i++) {
+		struct ast* ast = files[i].ast;
+		uint32_t* body = &ast->lists[ast->body];
+		for(uint32_t j = 1; j <= body[0]; j++) {
+			
+			if(ast->types[body[j]] != FUNCTION_DECLARATION) continue;
+			const char* name = ast->strings + ast->functions[ast->lhs[body[j]]].name;
+			
+			size_t slot = hash_name(name) & (table_size - 1);
+			while(table[slot].name && strcmp(table[slot].name, name)) slot = (slot + 1) & (table_size - 1);
+			
+			if(table[slot].name) {
+				fprintf(stderr, "E: Function \"%s\" in \"%s\" is already defined in \"%s\"!\n", name, files[i].path, files[table[slot].file].path);
+				duplicates = 1;
+				continue;
+			}
+			table[slot].name = name;
+			table[slot].file = i;
+			
+		}
+	}
+	free(table);
+	if(duplicates) fail();
+	
+	if(count == 1) return files[0].ast;
+	
+	// the arrays of all files are concatenated, with every index moved by what comes before it; the top-level
+	// list of every file is the last one it has, those are replaced by a single one for all files at the end;
+	// strings are interned again, so names shared between files are still only stored once
+	uint64_t node_count = 0, list_size = 1, declaration_count = 0;
+	for(size_t i = 0; i < count; i++) {
+		node_count += files[i].ast->node_count;
+		list_size += files[i].ast->list_size;
+		declaration_count += files[i].ast->function_count;
+	}
+	if(node_count >= NO_NODE || list_size >= UINT32_MAX || declaration_count >= UINT32_MAX) {
+		fprintf(stderr, "E: The program is too big!\n");
+		fail();
+	}
+	
+	struct ast* merged = calloc(1, sizeof(struct ast));
+	if(!merged) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	push_cleanup(ast_cleanup, merged);
+	merged->node_capacity = node_count;
+	merged->types = allocate_merged(node_count, sizeof(uint8_t));
+	merged->operators = allocate_merged(node_count, sizeof(uint8_t));
+	merged->lhs = allocate_merged(node_count, sizeof(uint32_t));
+	merged->rhs = allocate_merged(node_count, sizeof(uint32_t));
+	merged->list_capacity = list_size;
+	merged->lists = allocate_merged(list_size, sizeof(uint32_t));
+	merged->function_capacity = declaration_count;
+	merged->functions = allocate_merged(declaration_count, sizeof(struct function));
+	
+	uint32_t top_level = 0;
+	for(size_t i = 0; i < count; i++) {
+		
+		struct ast* ast = files[i].ast;
+		uint32_t nodes = merged->node_count, lists = merged->list_size, functions = merged->function_count;
+		
+		uint32_t* strings = allocate_merged(ast->string_size, sizeof(uint32_t)); // new offset by old offset
+		push_cleanup(free, strings);
+		for(uint32_t j = 0; j < ast->string_size; j += strlen(ast->strings + j) + 1) {
+			strings[j] = intern_string(merged, ast->strings + j, strlen(ast->strings + j));
+		}
+		
+		memcpy(merged->types + nodes, ast->types, ast->node_count);
+		memcpy(merged->operators + nodes, ast->operators, ast->node_count);
+		for(uint32_t j = 0; j < ast->node_count; j++) {
+			uint32_t lhs = ast->lhs[j], rhs = ast->rhs[j];
+			switch(ast->types[j]) {
+			case IDENTIFIER:
+				lhs = strings[lhs];
+				break;
+			case BINARY_EXPRESSION:
+				lhs += nodes;
+				rhs += nodes;
+				break;
+			case FUNCTION_DECLARATION:
+				lhs += functions;
+				break;
+			case RETURN_STATEMENT:
+				if(lhs != NO_NODE) lhs += nodes;
+				break;
+			default:
+				break;
+			}
+			merged->lhs[nodes + j] = lhs;
+			merged->rhs[nodes + j] = rhs;
+		}
+		
+		for(uint32_t j = 0; j < ast->function_count; j++) {
+			struct function function = ast->functions[j];
+			function.name = strings[function.name];
+			function.symbol = strings[function.symbol];
+			function.return_type = strings[function.return_type];
+			function.body += lists;
+			function.end += nodes;
+			merged->functions[functions + j] = function;
+		}
+		pop_cleanup(1); // strings
+		
+		for(uint32_t j = 0; j < ast->body; j += ast->lists[j] + 1) {
+			merged->lists[lists + j] = ast->lists[j];
+			for(uint32_t k = 1; k <= ast->lists[j]; k++) merged->lists[lists + j + k] = ast->lists[j + k] + nodes;
+		}
+		
+		merged->node_count += ast->node_count;
+		merged->list_size += ast->body;
+		merged->function_count += ast->function_count;
+		top_level += ast->lists[ast->body];
+		
+	}
+	
+	merged->body = merged->list_size;
+	merged->lists[merged->list_size++] = top_level;
+	uint32_t nodes = 0;
+	for(size_t i = 0; i < count; i++) {
+		struct ast* ast = files[i].ast;
+		uint32_t* body = &ast->lists[ast->body];
+		for(uint32_t j = 1; j <= body[0]; j++) merged->lists[merged->list_size++] = body[j] + nodes;
+		nodes += ast->node_count;
+	}
+	pop_cleanup(0);
+	
+	// the merged AST takes the place of the first file's, the others aren't needed anymore
+	for(size_t i = 0; i < count; i++) {
+		free_ast(files[i].ast);
+		files[i].ast = 0;
+	}
+	files[0].ast = merged;
+	return merged;
+	
+}
+
+void hash_files(struct source_file* files, size_t count, struct sha256* ctx) {
+	
+	sha256_update(ctx, &count, sizeof(count));
+	for(size_t i = 0; i < count; i++) {
+		if(is_module(&files[i].source)) {
+			sha256_update(ctx, ((struct module_header*)files[i].source.data)->hash, SHA256_SIZE);
+			continue;
+		}
+		sha256_update(ctx, &files[i].source.size, sizeof(files[i].source.size));
+		sha256_update(ctx, files[i].source.data, files[i].source.size);
+	}
+	
+}
+
+void free_files(struct source_file* files, size_t count) {
+	
+	for(size_t i = 0; i < count; i++) {
+		free_ast(files[i].ast);
+		free(files[i].tokens);
+		free_source(&files[i].source);
+	}
+	
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "input.h"
+#include "parser.h"
+#include "sha256.h"
+#include "error.h"
+
+struct source_file {
+	const char* path;
+	struct source source;
+	struct token* tokens;
+	size_t token_count; // not counting TOKEN_END
+	struct ast* ast;
+	int module; // the source is a module (see module.h), its AST is loaded instead of parsed
+	size_t lexer_threads; // set by tokenize_files(), large sources are split into that many chunks
+	int failed;
+};
+
+// both run on a pool of threads, one file at a time per thread
+void tokenize_files(struct source_file* files, size_t count);
+void parse_files(struct source_file* files, size_t count); // after tokenize_files()
+// Lexes source in up to threads chunks in parallel, the tokens are the same as the ones of tokenize().
+struct token* tokenize_parallel(const char* source, size_t size, size_t threads);
+struct ast* merge_files(struct source_file* files, size_t count); // joins all top-level statements in input order, the result replaces the first file's AST
+void hash_files(struct source_file* files, size_t count, struct sha256* ctx); // a module only adds its hash, so it isn't read
+void free_files(struct source_file* files, size_t count);
@@ -1,79 +1,165 @@
 #include "generator.h"
 #include <stdlib.h>
+#include <string.h>
+#include "error.h"
 
-#define OUTPUT_WRITE(...) if(!fprintf(file, __VA_ARGS__)) { \
-			fprintf(stderr, "E: Failed to write to output file!\n"); \
-			fclose(file); \
-			exit(1); \
-		} \
+const char* bin_op_string[] = {"+", "-", "*", "/", "%", "<<", ">>", "&"};
 
-char bin_op_char[] = {'+', '-', '*', '/', '%'};
+void generate_c_literal(struct ast* ast, uint32_t node, struct buffer* out) {
+	
+	uint64_t value = literal_value(ast, node);
+	enum literal_width width = ast->operators[node];
+	const char* suffix = width == LITERAL_64 ? "L" : width == LITERAL_64_UNSIGNED ? "UL" : ""; // i64 and u64 are long and unsigned long
+	if(width == LITERAL_64_UNSIGNED || (int64_t)value >= 0) {
+		buffer_append_unsigned(out, value);
+		buffer_append_string(out, suffix);
+		return;
+	}
+	
+	// negative values come from optimize(), and the smallest one has no positive counterpart of the same type
+	uint64_t magnitude = -value;
+	int minimum = magnitude == (width == LITERAL_32 ? 1ull << 31 : 1ull << 63);
+	buffer_append_string(out, "(-");
+	buffer_append_unsigned(out, magnitude - minimum);
+	buffer_append_string(out, suffix);
+	if(minimum) buffer_append_string(out, "-1");
+	buffer_append_char(out, ')');
+	
+}
 
-void generate_c_statement(struct statement* stmt, FILE* file) {
+struct expression_frame {
+	uint32_t node;
+	uint32_t state; // how many operands of a binary expression have been emitted
+};
+
+// Walks the expression with an explicit stack of frames, so the native stack doesn't grow with its depth.
+void generate_c_expression(struct ast* ast, uint32_t expr, struct buffer* out, struct buffer* stack) {
 	
-	switch(stmt->type) {
-	case NUMERIC_LITERAL: {
-		OUTPUT_WRITE("%d", ((struct numeric_literal*)stmt)->num);
-		break;
+	struct expression_frame frame = {expr, 0};
+	buffer_append(stack, (const char*)&frame, sizeof(frame));
+	
+	while(stack->size) {
+		
+		struct expression_frame* top = (struct expression_frame*)(stack->data + stack->size) - 1;
+		uint32_t node = top->node;
+		
+		switch(ast->types[node]) {
+		case NUMERIC_LITERAL:
+			generate_c_literal(ast, node, out);
+			stack->size -= sizeof(frame);
+			break;
+		case IDENTIFIER:
+			buffer_append_string(out, ast->strings + ast->lhs[node]);
+			stack->size -= sizeof(frame);
+			break;
+		case BINARY_EXPRESSION:
+			if(top->state == 2) {
+				buffer_append_char(out, ')');
+				stack->size -= sizeof(frame);
+				break;
+			}
+			if(top->state == 0) {
+				buffer_append_string(out, ast->operators[node] == OP_SHIFT_RIGHT ? "((u64)" : "(");
+				frame.node = ast->lhs[node];
+			} else {
+				buffer_append_string(out, bin_op_string[ast->operators[node]]);
+				frame.node = ast->rhs[node];
+			}
+			top->state++;
+			buffer_append(stack, (const char*)&frame, sizeof(frame)); // top isn't valid after this
+			break;
+		default:
+			fprintf(stderr, "Unimplemented expression: %d\n", ast->types[node]);
+			fail();
+		}
+		
 	}
-	case BINARY_EXPRESSION:
-		OUTPUT_WRITE("(");
-		generate_c_statement(((struct binary_expression*)stmt)->left, file);
-		OUTPUT_WRITE("%c", bin_op_char[((struct binary_expression*)stmt)->operator]);
-		generate_c_statement(((struct binary_expression*)stmt)->right, file);
-		OUTPUT_WRITE(")");
-		break;
-	case IDENTIFIER:
-		OUTPUT_WRITE("%s", ((struct identifier*)stmt)->symbol);
-		break;
-	case FUNCTION_DECLARATION:
-		for(struct statement_list* node = ((struct function_declaration*)stmt)->body; node->next; node = node->next) {
-			if(node->statement->type == FUNCTION_DECLARATION) generate_c_statement(node->statement, file);
+	
+}
+
+// Nested functions come before the function they are declared in, which is the only one that can see them.
+void generate_c_node(struct ast* ast, uint32_t node, struct buffer* out, struct buffer* stack, enum linkage linkage, int nested) {
+	
+	switch(ast->types[node]) {
+	case FUNCTION_DECLARATION: {
+		struct function* function = &ast->functions[ast->lhs[node]];
+		uint32_t* body = &ast->lists[function->body];
+		for(uint32_t i = 1; i <= body[0]; i++) {
+			if(ast->types[body[i]] == FUNCTION_DECLARATION) generate_c_node(ast, body[i], out, stack, linkage, 1);
 		}
-		OUTPUT_WRITE("%s %s(){\n",((struct function_declaration*)stmt)->return_type,  ((struct function_declaration*)stmt)->name);
-		for(struct statement_list* node = ((struct function_declaration*)stmt)->body; node->next; node = node->next) {
-			if(node->statement->type != FUNCTION_DECLARATION) {
-				generate_c_statement(node->statement, file);
-				OUTPUT_WRITE(";\n");
+		int internal = linkage != LINKAGE_EXTERNAL && (nested || (linkage == LINKAGE_PROGRAM && strcmp(ast->strings + function->symbol, "main")));
+		if(internal) buffer_append_string(out, function->end - node - 1 <= INLINE_NODES ? "static inline " : "static ");
+		buffer_append_string(out, ast->strings + function->return_type);
+		buffer_append_char(out, ' ');
+		buffer_append_string(out, ast->strings + function->symbol);
+		buffer_append_string(out, "(){\n");
+		for(uint32_t i = 1; i <= body[0]; i++) {
+			if(ast->types[body[i]] != FUNCTION_DECLARATION) {
+				generate_c_node(ast, body[i], out, stack, linkage, 1);
+				buffer_append_string(out, ";\n");
 			}
 		}
-		OUTPUT_WRITE("}");
+		buffer_append_char(out, '}');
 		break;
+	}
 	case RETURN_STATEMENT:
-		OUTPUT_WRITE("return ");
-		generate_c_statement(((struct return_statement*)stmt)->value, file);
+		buffer_append_string(out, "return ");
+		if(ast->lhs[node] != NO_NODE) generate_c_expression(ast, ast->lhs[node], out, stack);
 		break;
 	default:
-		fprintf(stderr, "Unimplemented statement: %d\n", stmt->type);
-		fclose(file);
-		exit(1);
+		generate_c_expression(ast, node, out, stack);
+		break;
 	}
 	
 }
 
-void generate_c(struct ast* ast, const char* path) {
+void generate_c_statement(struct ast* ast, uint32_t node, struct buffer* out, enum linkage linkage) {
+	
+	struct buffer stack = {0};
+	push_cleanup(buffer_cleanup, &stack);
+	generate_c_node(ast, node, out, &stack, linkage, 0);
+	pop_cleanup(1);
+	
+}
+
+void generate_c_prelude(struct buffer* out) {
+	
+	buffer_append_string(out, "typedef unsigned char u8;");
+	buffer_append_string(out, "typedef signed char i8;");
+	buffer_append_string(out, "typedef unsigned short u16;");
+	buffer_append_string(out, "typedef signed short i16;");
+	buffer_append_string(out, "typedef unsigned int u32;");
+	buffer_append_string(out, "typedef signed int i32;");
+	buffer_append_string(out, "typedef unsigned long u64;");
+	buffer_append_string(out, "typedef signed long i64;\n");
 	
-	FILE* file = fopen(path, "w");
-	if(!file) {
-		fprintf(stderr, "E: Failed to open/create file \"%s\"!\n", path);
-		exit(1);
+}
+
+void generate_c_header(struct ast* ast, struct buffer* out) {
+	
+	generate_c_prelude(out);
+	
+	uint32_t* body = &ast->lists[ast->body];
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		if(ast->types[body[i]] != FUNCTION_DECLARATION) continue;
+		struct function* function = &ast->functions[ast->lhs[body[i]]];
+		buffer_append_string(out, ast->strings + function->return_type);
+		buffer_append_char(out, ' ');
+		buffer_append_string(out, ast->strings + function->symbol);
+		buffer_append_string(out, "();\n");
 	}
 	
-	OUTPUT_WRITE("typedef unsigned char u8;");
-	OUTPUT_WRITE("typedef signed char i8;");
-	OUTPUT_WRITE("typedef unsigned short u16;");
-	OUTPUT_WRITE("typedef signed short i16;");
-	OUTPUT_WRITE("typedef unsigned int u32;");
-	OUTPUT_WRITE("typedef signed int i32;");
-	OUTPUT_WRITE("typedef unsigned long u64;");
-	OUTPUT_WRITE("typedef signed long i64;\n");
+}
+
+void generate_c(struct ast* ast, struct buffer* out, enum linkage linkage) {
 	
-	for(struct statement_list* node = ast->body; node->next; node = node->next) {
+	generate_c_prelude(out);
+	
+	uint32_t* body = &ast->lists[ast->body];
+	for(uint32_t i = 1; i <= body[0]; i++) {
 		
-		generate_c_statement(node->statement, file);
+		generate_c_statement(ast, body[i], out, linkage);
 		
 	}
 	
-	fclose(file);
-	
 }
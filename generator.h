@@ -1,4 +1,16 @@
 #pragma once
 #include "parser.h"
+#include "buffer.h"
 
-void generate_c(struct ast* ast, const char* path);
+#define INLINE_NODES 32 // function bodies up to this many nodes are marked inline when they're internal
+
+enum linkage { // which functions can be seen outside of the generated translation unit
+	LINKAGE_EXTERNAL, // all of them
+	LINKAGE_OBJECT, // only the top-level ones, for units that are compiled separately and linked
+	LINKAGE_PROGRAM // only main, for a unit with the whole program; gcc can inline and drop everything else
+};
+
+void generate_c_prelude(struct buffer* out); // the typedefs every translation unit needs
+void generate_c_header(struct ast* ast, struct buffer* out); // the prelude and prototypes of the top-level functions, for a program split into several units
+void generate_c_statement(struct ast* ast, uint32_t node, struct buffer* out, enum linkage linkage);
+void generate_c(struct ast* ast, struct buffer* out, enum linkage linkage);
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+#include "error.h"
+
+#define READ_BLOCK_SIZE (1024 * 1024)
+
+struct source map_source(int fd, size_t size, const char* path) {
+	
+	struct source source = {0};
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t mapped_size = (size + 1 + page_size - 1) & ~(page_size - 1);
+	
+	// reserve one byte more than the file in zeroed anonymous memory and map the file over it,
+	// so there is a NUL after the last byte even if the file size is a multiple of the page size
+	char* data = mmap(0, mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(data == MAP_FAILED) {
+		fprintf(stderr, "E: Failed to map file \"%s\"!\n", path);
+		fail();
+	}
+	if(mmap(data, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(data, mapped_size);
+		fprintf(stderr, "E: Failed to map file \"%s\"!\n", path);
+		fail();
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+	
+	source.data = data;
+	source.size = size;
+	source.mapped_size = mapped_size;
+	return source;
+	
+}
+
+struct source stream_source(int fd, const char* path) {
+	
+	struct source source = {0};
+	size_t capacity = 0;
+	
+	while(1) {
+		
+		if(capacity - source.size < READ_BLOCK_SIZE + 1) {
+			capacity = capacity ? capacity * 2 : 4 * READ_BLOCK_SIZE;
+			char* data = realloc(source.data, capacity);
+			if(!data) {
+				fprintf(stderr, "E: Failed to allocate memory!\n");
+				fail();
+			}
+			source.data = data;
+		}
+		
+		ssize_t ret = read(fd, source.data + source.size, capacity - source.size - 1);
+		if(ret < 0) {
+			if(errno == EINTR) continue;
+			fprintf(stderr, "E: Failed to read from file \"%s\"!\n", path);
+			free(source.data);
+			fail();
+		}
+		if(!ret) break;
+		source.size += ret;
+		
+	}
+	
+	source.data[source.size] = 0;
+	return source;
+	
+}
+
+void close_fd(void* fd) {
+	
+	close(*(int*)fd);
+	
+}
+
+struct source read_source(const char* path) {
+	
+	if(!strcmp(path, "-")) return stream_source(STDIN_FILENO, "<stdin>");
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "E: Failed to open file \"%s\"!\n", path);
+		fail();
+	}
+	
+	struct stat st;
+	if(fstat(fd, &st)) {
+		close(fd);
+		fprintf(stderr, "E: Failed to open file \"%s\"!\n", path);
+		fail();
+	}
+	
+	struct source source;
+	push_cleanup(close_fd, &fd);
+	if(S_ISREG(st.st_mode) && st.st_size > 0) source = map_source(fd, st.st_size, path);
+	else source = stream_source(fd, path); // pipes, character devices and empty files can't be mapped
+	
+	pop_cleanup(1);
+	return source;
+	
+}
+
+void free_source(struct source* source) {
+	
+	if(source->mapped_size) munmap(source->data, source->mapped_size);
+	else free(source->data);
+	
+	source->data = 0;
+	source->size = 0;
+	source->mapped_size = 0;
+	
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+
+struct source {
+	char* data; // always followed by a NUL byte, which is not counted in size
+	size_t size;
+	size_t mapped_size; // 0 if data is a heap buffer
+};
+
+struct source read_source(const char* path); // "-" reads from stdin
+void free_source(struct source* source);
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "buffer.h"
+#include "report.h"
+#include "error.h"
+
+enum opcode { // one byte each, only BC_PUSH has an operand: the 8 bytes of its value
+	BC_PUSH,
+	BC_POP,
+	BC_ADD, // the operations without a width work on 64 bits, signed or not
+	BC_ADD_32, // the 32-bit ones wrap their result around to an int
+	BC_SUBTRACT,
+	BC_SUBTRACT_32,
+	BC_MULTIPLY,
+	BC_MULTIPLY_32,
+	BC_DIVIDE_32,
+	BC_DIVIDE_64,
+	BC_DIVIDE_UNSIGNED,
+	BC_MODULO_32,
+	BC_MODULO_64,
+	BC_MODULO_UNSIGNED,
+	BC_SHIFT_LEFT,
+	BC_SHIFT_LEFT_32,
+	BC_SHIFT_RIGHT_UNSIGNED,
+	BC_AND,
+	BC_TO_U8, // the conversions to return types narrower than 64 bits
+	BC_TO_I8,
+	BC_TO_U16,
+	BC_TO_I16,
+	BC_TO_U32,
+	BC_TO_I32,
+	BC_RETURN
+};
+
+struct lowering {
+	struct ast* ast;
+	struct buffer code;
+	struct buffer frames; // of lower_expression()
+	struct buffer widths; // enum literal_width of every value on the stack at this point of the code, one byte each
+	size_t max_depth;
+};
+
+struct expression_frame {
+	uint32_t node;
+	uint32_t state; // how many operands of a binary expression have been lowered
+};
+
+void emit_opcode(struct lowering* l, enum opcode opcode) {
+	
+	buffer_append_char(&l->code, opcode);
+	
+}
+
+void emit_push(struct lowering* l, uint64_t value, enum literal_width width) {
+	
+	emit_opcode(l, BC_PUSH);
+	buffer_append(&l->code, (const char*)&value, sizeof(value));
+	buffer_append_char(&l->widths, width);
+	if(l->widths.size > l->max_depth) l->max_depth = l->widths.size;
+	
+}
+
+// Picks the opcode for the width of the result, which is the one of the wider operand like in C.
+// Shifts are the exception, their result has the width of the value that is shifted.
+void emit_operation(struct lowering* l, enum binary_operation operation) {
+	
+	enum literal_width left = l->widths.data[l->widths.size - 2];
+	enum literal_width right = l->widths.data[l->widths.size - 1];
+	enum literal_width width = left > right ? left : right;
+	enum opcode opcode;
+	
+	switch(operation) {
+	case OP_ADD: opcode = width == LITERAL_32 ? BC_ADD_32 : BC_ADD; break;
+	case OP_SUBTRACT: opcode = width == LITERAL_32 ? BC_SUBTRACT_32 : BC_SUBTRACT; break;
+	case OP_MULTIPLY: opcode = width == LITERAL_32 ? BC_MULTIPLY_32 : BC_MULTIPLY; break;
+	case OP_DIVIDE: opcode = width == LITERAL_32 ? BC_DIVIDE_32 : width == LITERAL_64 ? BC_DIVIDE_64 : BC_DIVIDE_UNSIGNED; break;
+	case OP_MODULO: opcode = width == LITERAL_32 ? BC_MODULO_32 : width == LITERAL_64 ? BC_MODULO_64 : BC_MODULO_UNSIGNED; break;
+	case OP_SHIFT_LEFT:
+		width = left;
+		opcode = width == LITERAL_32 ? BC_SHIFT_LEFT_32 : BC_SHIFT_LEFT;
+		break;
+	case OP_SHIFT_RIGHT:
+		width = LITERAL_64_UNSIGNED; // the generated code converts the left operand to u64
+		opcode = BC_SHIFT_RIGHT_UNSIGNED;
+		break;
+	default:
+		opcode = BC_AND;
+		break;
+	}
+	
+	emit_opcode(l, opcode);
+	l->widths.size--;
+	l->widths.data[l->widths.size - 1] = width;
+	
+}
+
+void lower_expression(struct lowering* l, uint32_t expr) {
+	
+	struct ast* ast = l->ast;
+	struct expression_frame frame = {expr, 0};
+	buffer_append(&l->frames, (const char*)&frame, sizeof(frame));
+	
+	while(l->frames.size) {
+		
+		struct expression_frame* top = (struct expression_frame*)(l->frames.data + l->frames.size) - 1;
+		uint32_t node = top->node;
+		
+		switch(ast->types[node]) {
+		case NUMERIC_LITERAL:
+			emit_push(l, literal_value(ast, node), ast->operators[node]);
+			l->frames.size -= sizeof(frame);
+			break;
+		case BINARY_EXPRESSION:
+			if(top->state == 2) {
+				emit_operation(l, ast->operators[node]);
+				l->frames.size -= sizeof(frame);
+				break;
+			}
+			frame.node = top->state ? ast->rhs[node] : ast->lhs[node];
+			top->state++;
+			buffer_append(&l->frames, (const char*)&frame, sizeof(frame)); // top isn't valid after this
+			break;
+		default:
+			fprintf(stderr, "Unimplemented expression: %d\n", ast->types[node]);
+			fail();
+		}
+		
+	}
+	
+}
+
+void emit_return(struct lowering* l, const char* type) { // returns the value on the stack as type
+	
+	static const char* types[] = {"u8", "i8", "u16", "i16", "u32", "i32"};
+	static const enum opcode conversions[] = {BC_TO_U8, BC_TO_I8, BC_TO_U16, BC_TO_I16, BC_TO_U32, BC_TO_I32};
+	
+	if(!strcmp(type, "void")) { // C leaves the exit status of a void main open, 0 is as good as any
+		emit_opcode(l, BC_POP);
+		l->widths.size--;
+		emit_push(l, 0, LITERAL_32);
+	}
+	for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if(!strcmp(type, types[i])) emit_opcode(l, conversions[i]);
+	}
+	emit_opcode(l, BC_RETURN);
+	l->widths.size--;
+	
+}
+
+void lower_function(struct lowering* l, uint32_t func) {
+	
+	struct ast* ast = l->ast;
+	struct function* function = &ast->functions[ast->lhs[func]];
+	const char* return_type = ast->strings + function->return_type;
+	uint32_t* body = &ast->lists[function->body];
+	
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		uint32_t node = body[i];
+		switch(ast->types[node]) {
+		case FUNCTION_DECLARATION: // nothing can call it yet
+			break;
+		case RETURN_STATEMENT:
+			if(ast->lhs[node] != NO_NODE) lower_expression(l, ast->lhs[node]);
+			else emit_push(l, 0, LITERAL_32); // whatever a function without a return value returns
+			emit_return(l, return_type);
+			break;
+		default:
+			lower_expression(l, node);
+			emit_opcode(l, BC_POP);
+			l->widths.size--;
+			break;
+		}
+	}
+	
+	emit_push(l, 0, LITERAL_32); // main returns 0 when it reaches its end
+	emit_return(l, return_type);
+	
+}
+
+int run_bytecode(const unsigned char* code, uint64_t* stack) {
+	
+	// threaded dispatch: every handler ends in a jump of its own to the next handler, which predicts better than one shared switch
+	static void* handlers[] = {
+		[BC_PUSH] = &&push, [BC_POP] = &&pop,
+		[BC_ADD] = &&add, [BC_ADD_32] = &&add_32, [BC_SUBTRACT] = &&subtract, [BC_SUBTRACT_32] = &&subtract_32,
+		[BC_MULTIPLY] = &&multiply, [BC_MULTIPLY_32] = &&multiply_32,
+		[BC_DIVIDE_32] = &&divide_32, [BC_DIVIDE_64] = &&divide_64, [BC_DIVIDE_UNSIGNED] = &&divide_unsigned,
+		[BC_MODULO_32] = &&modulo_32, [BC_MODULO_64] = &&modulo_64, [BC_MODULO_UNSIGNED] = &&modulo_unsigned,
+		[BC_SHIFT_LEFT] = &&shift_left, [BC_SHIFT_LEFT_32] = &&shift_left_32, [BC_SHIFT_RIGHT_UNSIGNED] = &&shift_right_unsigned,
+		[BC_AND] = &&and,
+		[BC_TO_U8] = &&to_u8, [BC_TO_I8] = &&to_i8, [BC_TO_U16] = &&to_u16, [BC_TO_I16] = &&to_i16, [BC_TO_U32] = &&to_u32, [BC_TO_I32] = &&to_i32,
+		[BC_RETURN] = &&return_
+	};
+#define NEXT goto *handlers[*code++]
+#define WRAP_32(value) ((uint64_t)(int64_t)(int32_t)(uint32_t)(value)) // values of 32-bit width are kept sign-extended
+	
+	uint64_t* sp = stack; // the next free slot
+	NEXT;
+	
+push:
+	memcpy(sp++, code, sizeof(uint64_t));
+	code += sizeof(uint64_t);
+	NEXT;
+pop:
+	sp--;
+	NEXT;
+add:
+	sp[-2] += sp[-1];
+	sp--;
+	NEXT;
+add_32:
+	sp[-2] = WRAP_32(sp[-2] + sp[-1]);
+	sp--;
+	NEXT;
+subtract:
+	sp[-2] -= sp[-1];
+	sp--;
+	NEXT;
+subtract_32:
+	sp[-2] = WRAP_32(sp[-2] - sp[-1]);
+	sp--;
+	NEXT;
+multiply:
+	sp[-2] *= sp[-1];
+	sp--;
+	NEXT;
+multiply_32:
+	sp[-2] = WRAP_32(sp[-2] * sp[-1]);
+	sp--;
+	NEXT;
+divide_32:
+	if(!sp[-1]) goto division_by_zero;
+	sp[-2] = (int32_t)sp[-1] == -1 ? WRAP_32(0 - sp[-2]) : WRAP_32((int32_t)sp[-2] / (int32_t)sp[-1]); // INT_MIN / -1 wraps around
+	sp--;
+	NEXT;
+divide_64:
+	if(!sp[-1]) goto division_by_zero;
+	sp[-2] = (int64_t)sp[-1] == -1 ? 0 - sp[-2] : (uint64_t)((int64_t)sp[-2] / (int64_t)sp[-1]);
+	sp--;
+	NEXT;
+divide_unsigned:
+	if(!sp[-1]) goto division_by_zero;
+	sp[-2] /= sp[-1];
+	sp--;
+	NEXT;
+modulo_32:
+	if(!sp[-1]) goto division_by_zero;
+	sp[-2] = (int32_t)sp[-1] == -1 ? 0 : WRAP_32((int32_t)sp[-2] % (int32_t)sp[-1]);
+	sp--;
+	NEXT;
+modulo_64:
+	if(!sp[-1]) goto division_by_zero;
+	sp[-2] = (int64_t)sp[-1] == -1 ? 0 : (uint64_t)((int64_t)sp[-2] % (int64_t)sp[-1]);
+	sp--;
+	NEXT;
+modulo_unsigned:
+	if(!sp[-1]) goto division_by_zero;
+	sp[-2] %= sp[-1];
+	sp--;
+	NEXT;
+shift_left:
+	sp[-2] <<= sp[-1] & 63;
+	sp--;
+	NEXT;
+shift_left_32:
+	sp[-2] = WRAP_32(sp[-2] << (sp[-1] & 31));
+	sp--;
+	NEXT;
+shift_right_unsigned:
+	sp[-2] >>= sp[-1] & 63;
+	sp--;
+	NEXT;
+and:
+	sp[-2] &= sp[-1];
+	sp--;
+	NEXT;
+to_u8:
+	sp[-1] = (uint8_t)sp[-1];
+	NEXT;
+to_i8:
+	sp[-1] = (int8_t)sp[-1];
+	NEXT;
+to_u16:
+	sp[-1] = (uint16_t)sp[-1];
+	NEXT;
+to_i16:
+	sp[-1] = (int16_t)sp[-1];
+	NEXT;
+to_u32:
+	sp[-1] = (uint32_t)sp[-1];
+	NEXT;
+to_i32:
+	sp[-1] = WRAP_32(sp[-1]);
+	NEXT;
+return_:
+	return (int)sp[-1];
+division_by_zero:
+	fprintf(stderr, "E: Division by zero!\n");
+	fail();
+	
+#undef NEXT
+#undef WRAP_32
+}
+
+void free_lowering(void* arg) {
+	
+	struct lowering* l = arg;
+	buffer_free(&l->code);
+	buffer_free(&l->frames);
+	buffer_free(&l->widths);
+	
+}
+
+int interpret(struct ast* ast) {
+	
+	uint32_t main_function = NO_NODE;
+	uint32_t* body = &ast->lists[ast->body];
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		if(ast->types[body[i]] != FUNCTION_DECLARATION) {
+			fprintf(stderr, "E: Only functions are allowed at the top level!\n");
+			fail();
+		}
+		if(!strcmp(ast->strings + ast->functions[ast->lhs[body[i]]].symbol, "main")) main_function = body[i];
+	}
+	if(main_function == NO_NODE) {
+		fprintf(stderr, "E: No main function!\n");
+		fail();
+	}
+	
+	struct lowering l = {ast};
+	push_cleanup(free_lowering, &l);
+	report_begin(PHASE_GENERATE);
+	lower_function(&l, main_function);
+	report_end(PHASE_GENERATE);
+	
+	uint64_t* stack = malloc(l.max_depth * sizeof(uint64_t));
+	if(!stack) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	push_cleanup(free, stack);
+	report_begin(PHASE_RUN);
+	int status = run_bytecode((const unsigned char*)l.code.data, stack);
+	report_end(PHASE_RUN);
+	pop_cleanup(1); // stack
+	pop_cleanup(1); // l
+	return status;
+	
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "parser.h"
+
+// Runs a program without a C compiler: main is lowered to bytecode for a value stack and executed by a loop that
+// jumps straight from one instruction's handler to the next one's. Arithmetic follows the generated C code, with
+// signed overflow wrapping around like in optimize(). Returns main's value converted to its return type, which
+// makes the exit status.
+int interpret(struct ast* ast);
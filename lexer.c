@@ -1,161 +1,290 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "lexer.h"
+#include "scan.h"
+#include "error.h"
 
 int is_whitespace(char ch) {
-	return (ch == ' ' || ch == '\t' || ch == '\n');
+	return char_class[(unsigned char)ch] & CHAR_WHITESPACE;
 }
 
 int is_letter(char ch) { // underscores also count as letters, its just easier this way
-	return ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_');
+	return char_class[(unsigned char)ch] & CHAR_LETTER;
 }
 
 int is_digit(char ch) {
-	return (ch >= '0' && ch <= '9');
+	return char_class[(unsigned char)ch] & CHAR_DIGIT;
 }
 
-int is_punctuator(char ch) {
+enum punctuator get_punctuator(char ch) {
 	
 	switch(ch) {
-	case '(':
-	case ')':
-	case '{':
-	case '}':
-	case '[':
-	case ']':
-	case ';':
-	case ',':
-		return 1;
-	default:
-		return 0;
+	case '(': return PUNCTUATOR_OPEN_PAREN;
+	case ')': return PUNCTUATOR_CLOSE_PAREN;
+	case '{': return PUNCTUATOR_OPEN_BRACE;
+	case '}': return PUNCTUATOR_CLOSE_BRACE;
+	case '[': return PUNCTUATOR_OPEN_BRACKET;
+	case ']': return PUNCTUATOR_CLOSE_BRACKET;
+	case ';': return PUNCTUATOR_SEMICOLON;
+	case ',': return PUNCTUATOR_COMMA;
+	default: return PUNCTUATOR_INVALID;
 	}
 	
 }
 
 int is_operator(char ch) {
+	return char_class[(unsigned char)ch] & CHAR_OPERATOR;
+}
+
+enum operator get_operator(const char* start, int* size) { // longest match, so "->" wins over "-"
 	
-	switch(ch) {
-	case '+':
+	*size = 2;
+	switch(start[0]) {
 	case '-':
-	case '*':
-	case '/':
-	case '%':
+		if(start[1] == '>') return OPERATOR_ARROW;
+		break;
 	case '=':
+		if(start[1] == '=') return OPERATOR_EQUAL;
+		break;
 	case '!':
+		if(start[1] == '=') return OPERATOR_NOT_EQUAL;
+		break;
 	case '<':
+		if(start[1] == '=') return OPERATOR_LESS_EQUAL;
+		break;
 	case '>':
-		return 1;
-	default:
-		return 0;
+		if(start[1] == '=') return OPERATOR_GREATER_EQUAL;
+		break;
+	}
+	
+	*size = 1;
+	switch(start[0]) {
+	case '+': return OPERATOR_PLUS;
+	case '-': return OPERATOR_MINUS;
+	case '*': return OPERATOR_ASTERISK;
+	case '/': return OPERATOR_SLASH;
+	case '%': return OPERATOR_PERCENT;
+	case '=': return OPERATOR_ASSIGN;
+	case '!': return OPERATOR_NOT;
+	case '<': return OPERATOR_LESS;
+	case '>': return OPERATOR_GREATER;
+	default: return OPERATOR_INVALID;
 	}
 	
 }
 
 enum keyword get_keyword(const char* start, int size) {
-	if(size == 2 && memcmp(start, "fn", 2)) return KEYWORD_FN;
-	if(size == 6 && memcmp(start, "return", 6)) return KEYWORD_RETURN;
+	if(size == 2 && !memcmp(start, "fn", 2)) return KEYWORD_FN;
+	if(size == 6 && !memcmp(start, "return", 6)) return KEYWORD_RETURN;
 	return KEYWORD_INVALID;
 }
 
-int check_integer_literal(const char* start) {
-	
-	int base = 10;
-	
-	if(start[0] == '0') {
-		if(start[1] == 'b') {
-			base = 2;
-			start += 2;
-		} else if(start[1] == 'o') {
-			base = 8;
-			start += 2;
-		} else if(start[1] == 'x') {
-			base = 16;
-			start += 2;
-		}
+#define ONES 0x0101010101010101ull
+#define HIGH_BITS (ONES * 0x80)
+
+const uint64_t powers_of_ten[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+uint64_t load_word(const char* p) { // 8 bytes from p, the first one in the lowest byte, without touching the next page
+	
+	uint64_t word = 0;
+	if(((uintptr_t)p & 4095) <= 4096 - 8) {
+		memcpy(&word, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+	} else {
+		for(int i = 0; i < 8 && p[i]; i++) word |= (uint64_t)(unsigned char)p[i] << i * 8;
 	}
+	return word;
+	
+}
+
+uint64_t bytes_between(uint64_t word, unsigned int low, unsigned int high) { // sets the high bit of every byte with low < byte < high
+	
+	uint64_t ascii = word & ONES * 0x7f; // bytes from 0x80 up fail the ~word, so no byte can carry into the next one
+	return (ONES * (0x7f + high) - ascii) & ~word & (ascii + ONES * (0x7f - low)) & HIGH_BITS;
+	
+}
+
+int run_length(uint64_t run) { // the number of bytes before the first one without its high bit set in run
+	
+	uint64_t end = ~run & HIGH_BITS;
+	return end ? __builtin_ctzll(end) / 8 : 8;
+	
+}
+
+uint64_t first_bytes(uint64_t word, int count) { // moves the first count bytes to the top, the ones shifted in are zero
+	
+	if(count < 8) word <<= (8 - count) * 8;
+	return word;
+	
+}
+
+// Parses 8 digits at a time: the word holds the digit values of 8 bytes, which get multiplied together in pairs,
+// then the pairs in pairs and so on. Subtracting '0' from the bytes after the digits may borrow from later ones, which get dropped anyway.
+const char* parse_decimal(const char* p, uint64_t* value, int* overflow) {
+	
+	uint64_t result = 0;
+	
+	while(1) {
+		uint64_t word = load_word(p);
+		int count = run_length(bytes_between(word, '0' - 1, '9' + 1));
+		if(!count) break;
+		uint64_t digits = first_bytes(word - ONES * '0', count); // leading zero digits don't change the value
+		digits = digits * 10 + (digits >> 8);
+		digits = ((digits & 0x000000ff000000ff) * (100 + (1000000ull << 32)) + ((digits >> 16) & 0x000000ff000000ff) * (1 + (10000ull << 32))) >> 32;
+		*overflow |= __builtin_mul_overflow(result, powers_of_ten[count], &result);
+		*overflow |= __builtin_add_overflow(result, (uint32_t)digits, &result);
+		p += count;
+		if(count < 8) break;
+	}
+	
+	*value = result;
+	return p;
+	
+}
+
+const char* parse_hex(const char* p, uint64_t* value, int* overflow) {
 	
-	for(int i = 0; is_digit(start[i]) || is_letter(start[i]); i++) {
-		if(base == 2 && (start[i] < '0' || start[i] > '1')) return 0;
-		if(base == 8 && (start[i] < '0' || start[i] > '7')) return 0;
-		if(base == 10 && (start[i] < '0' || start[i] > '9')) return 0;
-		if(base == 16 && ((start[i] < '0' || start[i] > '9') && (start[i] < 'a' || start[i] > 'f') && (start[i] < 'A' || start[i] > 'F'))) return 0;
+	uint64_t result = 0;
+	
+	while(1) {
+		uint64_t word = load_word(p);
+		int count = run_length(bytes_between(word, '0' - 1, '9' + 1) | bytes_between(word | ONES * 0x20, 'a' - 1, 'f' + 1));
+		if(!count) break;
+		uint64_t nibbles = (word & ONES * 0x0f) + ((word >> 6) & ONES) * 9; // letters have bit 6 set and their value in the low bits minus 9
+		nibbles = first_bytes(nibbles, count);
+		nibbles = ((nibbles << 4) | (nibbles >> 8)) & 0x00ff00ff00ff00ff;
+		nibbles = (nibbles | (nibbles >> 8)) & 0x0000ffff0000ffff;
+		uint32_t digits = __builtin_bswap32((uint32_t)(nibbles | (nibbles >> 16)));
+		if(result >> (64 - count * 4)) *overflow = 1;
+		result = result << count * 4 | digits;
+		p += count;
+		if(count < 8) break;
 	}
 	
-	return 1;
+	*value = result;
+	return p;
 	
 }
 
-int parse_integer_literal(const char* start) {
-	
-	int ret = 0;
-	int base = 10;
-	
-	if(start[0] == '0') {
-		if(start[1] == 'b') {
-			base = 2;
-			start += 2;
-		} else if(start[1] == 'o') {
-			base = 8;
-			start += 2;
-		} else if(start[1] == 'x') {
-			base = 16;
-			start += 2;
+const char* parse_integer_literal(const char* start, uint64_t* value, int* overflow) {
+	
+	*overflow = 0;
+	const char* digits = start;
+	if(start[0] == '0' && (start[1] == 'b' || start[1] == 'o' || start[1] == 'x')) digits += 2;
+	
+	const char* p;
+	if(digits == start) p = parse_decimal(digits, value, overflow);
+	else if(start[1] == 'x') p = parse_hex(digits, value, overflow);
+	else { // binary and octal are rare enough for one digit at a time
+		int bits = start[1] == 'b' ? 1 : 3;
+		uint64_t result = 0;
+		for(p = digits; *p >= '0' && *p < '0' + (1 << bits); p++) {
+			if(result >> (64 - bits)) *overflow = 1;
+			result = result << bits | (*p - '0');
 		}
+		*value = result;
 	}
 	
-	for(int i = 0; is_digit(start[i]) || is_letter(start[i]); i++) {
-		
-		ret *= base;
-		if(start[i] >= '0' && start[i] <= '9') ret += start[i] - '0';
-		else if(start[i] >= 'a' && start[i] <= 'f') ret += start[i] - 'a' + 0xa;
-		else ret += start[i] - 'A' + 0xa;
-		
+	if(p == digits || is_letter(*p) || is_digit(*p)) return 0; // no digits after the prefix, or ones that don't belong to the base
+	return p;
+	
+}
+
+struct token_buffer {
+	struct token* data;
+	size_t size;
+	size_t capacity;
+};
+
+struct token* push_token(struct token_buffer* buf, enum token_type type, int kind, int line, size_t offset, size_t length) {
+	
+	if(buf->size == buf->capacity) {
+		size_t capacity = buf->capacity ? buf->capacity * 2 : 256;
+		struct token* data = realloc(buf->data, capacity * sizeof(struct token));
+		if(!data) {
+			fprintf(stderr, "E: Failed to allocate memory!\n");
+			fail();
+		}
+		buf->data = data;
+		buf->capacity = capacity;
 	}
 	
-	return ret;
+	struct token* token = &buf->data[buf->size++];
+	token->type = type;
+	token->kind = kind;
+	token->line = line;
+	token->length = length;
+	token->offset = offset;
+	return token;
 	
 }
 
-struct token* tokenize(const char* source) {
+void free_token_buffer(void* buf) {
 	
-	int line = 1;
-	size_t buf_size = sizeof(struct token);
+	free(((struct token_buffer*)buf)->data);
 	
-	for(int i = 0; source[i];) {
+}
+
+int tokenize_into(struct token_buffer* buf, const char* source, size_t start, size_t end, int line, int quiet) { // returns the line at end
+	
+	size_t i = start;
+	
+	while(i < end) {
 		
 		if(is_whitespace(source[i])) {
-			if(source[i] == '\n') line++;
-			i++;
+			if(!is_whitespace(source[i + 1])) { // single characters between tokens are too short to be worth a vector load
+				if(source[i] == '\n') line++;
+				i++;
+				continue;
+			}
+			size_t newlines = 0;
+			i = scan.whitespace(&source[i], &newlines) - source;
+			line += newlines;
 			continue;
 		}
 		if(is_letter(source[i])) {
-			int start = i;
-			while(is_letter(source[i]) || is_digit(source[i])) i++;
-			if(get_keyword(&source[i], i - start) != KEYWORD_INVALID) buf_size += sizeof(struct token) + sizeof(enum keyword);
-			else buf_size += sizeof(struct token) + i - start + 1; 
+			size_t start = i;
+			i = scan.word(&source[i]) - source;
+			enum keyword keyword = get_keyword(&source[start], i - start);
+			if(keyword != KEYWORD_INVALID) push_token(buf, TOKEN_KEYWORD, keyword, line, start, i - start);
+			else push_token(buf, TOKEN_IDENTIFIER, 0, line, start, i - start);
 			continue;
 		}
 		if(is_digit(source[i])) {
-			if(!check_integer_literal(&source[i])) {
-				fprintf(stderr, "E: Invalid integer literal in line %d!\n", line);
-				exit(1);
+			uint64_t value;
+			int overflow;
+			const char* end = parse_integer_literal(&source[i], &value, &overflow);
+			if(!end) {
+				if(!quiet) fprintf(stderr, "E: Invalid integer literal in line %d!\n", line);
+				fail();
+			}
+			if(overflow) {
+				if(!quiet) fprintf(stderr, "E: Integer literal in line %d doesn't fit into 64 bits!\n", line);
+				fail();
 			}
-			while(is_letter(source[i]) || is_digit(source[i])) i++;
-			buf_size += sizeof(struct token) + sizeof(int);
+			enum literal_width width = value <= INT32_MAX ? LITERAL_32 : value <= INT64_MAX ? LITERAL_64 : LITERAL_64_UNSIGNED;
+			push_token(buf, TOKEN_INTEGER_LITERAL, width, line, 0, end - &source[i])->value = value;
+			i = end - source;
 			continue;
 		}
-		if(is_punctuator(source[i])) {
+		enum punctuator punctuator = get_punctuator(source[i]);
+		if(punctuator != PUNCTUATOR_INVALID) {
+			push_token(buf, TOKEN_PUNCTUATOR, punctuator, line, i, 1);
 			i++;
-			buf_size += sizeof(struct token) + 1;
 			continue;
 		}
 		if(is_operator(source[i])) {
-			int start = i;
-			while(is_operator(source[i])) i++;
-			buf_size += sizeof(struct token) + i - start + 1;
+			int size;
+			enum operator operator = get_operator(&source[i], &size);
+			push_token(buf, TOKEN_OPERATOR, operator, line, i, size);
+			i += size;
 			continue;
 		}
 		if(source[i] == '"') {
+			size_t start = i;
 			i++;
 			while(1) {
 				if(source[i] == '\\') { // ESCAPE SEQUENCES
@@ -165,157 +294,70 @@ struct token* tokenize(const char* source) {
 					case 't':
 					case '\\':
 					case '"':
-						buf_size++;
 						i++;
 						break;
 					default:
-						fprintf(stderr, "E: Invalid escape sequence in line %d!\n", line);
-						exit(1);
+						if(!quiet) fprintf(stderr, "E: Invalid escape sequence in line %d!\n", line);
+						fail();
 					}
 					continue;
 				}
 				if(source[i] == 0 || source[i] == '\n') { // END
-					fprintf(stderr, "Unclosed string literal in line %d!\n", line);
-					exit(1);
+					if(!quiet) fprintf(stderr, "Unclosed string literal in line %d!\n", line);
+					fail();
 				} else if(source[i] == '"') { // CLOSE
 					break;
 				}
-				buf_size++;
 				i++;
 			}
-			buf_size += sizeof(struct token) + 1;
 			i++;
+			push_token(buf, TOKEN_STRING_LITERAL, 0, line, start, i - start);
 			continue;
 		}
 		if(source[i] == '#') {
-			while(source[i] != '\n' && source[i]) i++;
+			i = scan.comment(&source[i]) - source;
 			continue;
 		}
-		fprintf(stderr, "E: Invalid token in line %d: %c\n", line, source[i]);
-		exit(1);
+		if(!quiet) fprintf(stderr, "E: Invalid token in line %d: %c\n", line, source[i]);
+		fail();
 		
 	}
 	
-	struct token* tokens = malloc(buf_size);
-	if(!tokens) {
-		fprintf(stderr, "E: Failed to allocate memory!\n");
-		exit(1);
-	}
-	struct token* token = tokens;
-	line = 1;
+	return line;
 	
-	for(int i = 0; source[i];) {
-		
-		if(is_whitespace(source[i])) {
-			if(source[i] == '\n') line++;
-			i++;
-			continue;
-		}
-		if(is_letter(source[i])) {
-			int start = i;
-			while(is_letter(source[i]) || is_digit(source[i])) i++;
-			enum keyword keyword = get_keyword(&source[i], i - start);
-			if(keyword != KEYWORD_INVALID) {
-				token->type = TOKEN_KEYWORD;
-				token->size = sizeof(enum keyword);
-				*(enum keyword*)token->data = keyword;
-			}
-			else {
-				token->type = TOKEN_IDENTIFIER;
-				token->size = i - start + 1;
-				memcpy(token->data, &source[start], i - start);
-				token->data[i - start] = 0;
-			}
-			token->line = line;
-			token = (struct token*)((size_t)token + sizeof(struct token) + token->size);
-			continue;
-		}
-		if(is_digit(source[i])) {
-			int start = i;
-			while(is_letter(source[i]) || is_digit(source[i])) i++;
-			token->type = TOKEN_INTEGER_LITERAL;
-			token->size = sizeof(int);
-			*(int*)token->data = parse_integer_literal(&source[start]);
-			token->line = line;
-			token = (struct token*)((size_t)token + sizeof(struct token) + token->size);
-			continue;
-		}
-		if(is_punctuator(source[i])) {
-			token->type = TOKEN_PUNCTUATOR;
-			token->size = 1;
-			token->data[0] = source[i];
-			i++;
-			token->line = line;
-			token = (struct token*)((size_t)token + sizeof(struct token) + token->size);
-			continue;
-		}
-		if(is_operator(source[i])) {
-			int start = i;
-			while(is_operator(source[i])) i++;
-			token->type = TOKEN_OPERATOR;
-			token->size = i - start + 1;
-			memcpy(token->data, &source[start], i - start);
-			token->data[i - start] = 0;
-			token->line = line;
-			token = (struct token*)((size_t)token + sizeof(struct token) + token->size);
-			continue;
-		}
-		if(source[i] == '"') {
-			token->type = TOKEN_STRING_LITERAL;
-			int j = 0;
-			i++;
-			while(1) {
-				if(source[i] == '\\') { // ESCAPE SEQUENCES
-					i++;
-					switch(source[i]) {
-					case 'n':
-						token->data[j] = '\n';
-						j++;
-						i++;
-						break;
-					case 't':
-						token->data[j] = '\t';
-						j++;
-						i++;
-						break;
-					case '\\':
-						token->data[j] = '\\';
-						j++;
-						i++;
-						break;
-					case '"':
-						token->data[j] = '"';
-						j++;
-						i++;
-						break;
-					}
-					continue;
-				}
-				if(source[i] == '"') { // CLOSE
-					break;
-				}
-				token->data[j] = source[i];
-				j++;
-				i++;
-			}
-			token->data[j] = 0;
-			token->size = j;
-			i++;
-			token->line = line;
-			token = (struct token*)((size_t)token + sizeof(struct token) + token->size);
-			continue;
-		}
-		if(source[i] == '#') {
-			while(source[i] != '\n' && source[i]) i++;
-			continue;
-		}
-		
-	}
+}
+
+struct token* tokenize(const char* source, size_t size) {
 	
-	token->type = TOKEN_END;
-	token->size = 0;
-	token->line = line;
+	struct token_buffer buf = {0};
+	push_cleanup(free_token_buffer, &buf);
+	int line = tokenize_into(&buf, source, 0, size, 1, 0);
+	push_token(&buf, TOKEN_END, 0, line, size, 0);
+	pop_cleanup(0);
+	
+	return buf.data;
+	
+}
+
+struct token* tokenize_range(const char* source, size_t start, size_t end, int line, size_t* count, int quiet) {
+	
+	struct token_buffer buf = {0};
+	push_cleanup(free_token_buffer, &buf);
+	tokenize_into(&buf, source, start, end, line, quiet);
+	pop_cleanup(0);
+	
+	*count = buf.size;
+	return buf.data;
+	
+}
+
+size_t chunk_boundary(const char* source, size_t size, size_t position) {
 	
-	return tokens;
+	// strings can't span lines and comments end with them, so the text after a newline is always between tokens
+	const char* newline = memchr(&source[position], '\n', size - position);
+	if(!newline) return size;
+	size_t boundary = newline - source;
+	while(is_whitespace(source[boundary])) boundary++; // the whitespace before the boundary ends exactly there
+	return boundary;
 	
 }
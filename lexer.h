@@ -1,5 +1,6 @@
 #pragma once
 #include <stdio.h>
+#include <stdint.h>
 
 enum keyword {
 	KEYWORD_INVALID,
@@ -7,6 +8,36 @@ enum keyword {
 	KEYWORD_RETURN
 };
 
+enum punctuator {
+	PUNCTUATOR_INVALID,
+	PUNCTUATOR_OPEN_PAREN, // (
+	PUNCTUATOR_CLOSE_PAREN, // )
+	PUNCTUATOR_OPEN_BRACE, // {
+	PUNCTUATOR_CLOSE_BRACE, // }
+	PUNCTUATOR_OPEN_BRACKET, // [
+	PUNCTUATOR_CLOSE_BRACKET, // ]
+	PUNCTUATOR_SEMICOLON, // ;
+	PUNCTUATOR_COMMA // ,
+};
+
+enum operator {
+	OPERATOR_INVALID,
+	OPERATOR_PLUS, // +
+	OPERATOR_MINUS, // -
+	OPERATOR_ASTERISK, // *
+	OPERATOR_SLASH, // /
+	OPERATOR_PERCENT, // %
+	OPERATOR_ARROW, // ->
+	OPERATOR_ASSIGN, // =
+	OPERATOR_EQUAL, // ==
+	OPERATOR_NOT, // !
+	OPERATOR_NOT_EQUAL, // !=
+	OPERATOR_LESS, // <
+	OPERATOR_LESS_EQUAL, // <=
+	OPERATOR_GREATER, // >
+	OPERATOR_GREATER_EQUAL // >=
+};
+
 enum token_type {
 	TOKEN_KEYWORD, // e.g. fn
 	TOKEN_STRING_LITERAL, // e.g. "Hello world!\n"
@@ -17,11 +48,29 @@ enum token_type {
 	TOKEN_END // end of the token list
 };
 
+enum literal_width { // the smallest C type that holds the value
+	LITERAL_32, // int
+	LITERAL_64, // long
+	LITERAL_64_UNSIGNED // unsigned long
+};
+
 struct token {
 	enum token_type type;
-	int size;
+	int kind; // enum keyword, enum punctuator, enum operator or enum literal_width, depending on the type
 	int line;
-	char data[0];
+	unsigned int length; // the token's text is source[offset] to source[offset + length - 1], quotes included for string literals
+	union {
+		size_t offset;
+		uint64_t value; // integer literals are parsed by the lexer and have no offset
+	};
 };
 
-struct token* tokenize(const char* source);
+const char* parse_integer_literal(const char* start, uint64_t* value, int* overflow); // returns the end, or NULL if it's malformed
+struct token* tokenize(const char* source, size_t size); // source[size] has to be NUL
+
+// For lexing parts of a source in parallel: source[start] to source[end - 1] have to begin and end between tokens,
+// like at the positions chunk_boundary() returns. line is the one source[start] is in, for the tokens and errors.
+// Returns *count tokens (possibly NULL for none) with offsets into the whole source and without a TOKEN_END.
+// With quiet set, errors in the source fail without a message.
+struct token* tokenize_range(const char* source, size_t start, size_t end, int line, size_t* count, int quiet);
+size_t chunk_boundary(const char* source, size_t size, size_t position); // the next position a chunk can start at, or size
@@ -1,31 +1,78 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "lexer.h"
-#include "parser.h"
-#include "generator.h"
+#include "frontend.h"
+#include "build.h"
+#include "native.h"
+#include "resolve.h"
+#include "optimize.h"
+#include "module.h"
+#include "interpreter.h"
+#include "cache.h"
+#include "server.h"
+#include "error.h"
+#include "report.h"
 
 #define DEFAULT_OUTPUT "caro.out"
+#define MAX_JOBS 256
+
+enum backend {
+	BACKEND_C, // generate C and compile it with gcc
+	BACKEND_NATIVE // write an x86-64 ELF executable directly
+};
 
 struct compilation_options {
-	const char* input;
+	const char** inputs;
+	size_t input_count;
 	const char* output;
+	enum backend backend;
+	const char* cache_dir; // NULL for the default one
+	int no_cache;
+	int incremental;
 	int preserve;
+	int stats;
+	int emit_module;
+	int run;
+	const char* optimization; // the whole argument, e.g. "-O2"
+	const char* arch; // the whole argument, e.g. "-march=native"
+	size_t jobs; // translation units to compile in parallel, 0 if not given
+	const char* pgo_train; // shell command that runs the instrumented program, NULL without profile-guided optimization
+	enum report_format time_report;
 };
 
 void help() {
 	
-	printf("Usage: caro [options] file\n");
+	printf("Usage: caro [options] file...\n");
+	printf("       caro --server socket - stay resident and compile requests sent to the Unix socket\n");
+	printf("       caro --connect socket [options] file... - let the server at socket do the compilation\n");
+	printf("\tfile - source file, or \"-\" to read it from stdin; multiple files are parsed in parallel and compiled into one program\n");
 	printf("\t[-h | --help] - print this help message\n");
 	printf("\t[-o | --output] file - set output file (default: \"%s\")\n", DEFAULT_OUTPUT);
-	printf("\t[-p | --preserve] - don't delete the temporary C file\n");
-	exit(1);
+	printf("\t[-b | --backend] c|native - compile through gcc or emit x86-64 machine code directly (default: c)\n");
+	printf("\t[--cache-dir] dir - cache compiled executables in dir (default: \"$XDG_CACHE_HOME/caro\" or \"~/.cache/caro\")\n");
+	printf("\t[--no-cache] - always compile, don't look up or store anything in the cache\n");
+	printf("\t[-i | --incremental] - compile every top-level function into its own cached object file and only recompile changed ones\n");
+	printf("\t[-p | --preserve] - also write the generated C code to \"<output>.c\"\n");
+	printf("\t[-O0 | -O1 | -O2 | -O3 | -Os] - have gcc optimize, above -O0 the generated code keeps all functions but main to itself\n");
+	printf("\t[-j | --jobs] n - split the generated C code into n translation units and run that many gcc processes at once (at most %d)\n", MAX_JOBS);
+	printf("\t[--pgo-train] command - build the program instrumented, run the shell command to train it and rebuild it with the profile, which is cached for later builds\n");
+	printf("\t[-march=arch] - have gcc generate code for arch, e.g. \"native\"\n");
+	printf("\t[-s | --stats] - print memory statistics of the compilation\n");
+	printf("\t[-r | --run] - run the program with the built-in interpreter instead of building it, main's value becomes the exit status\n");
+	printf("\t[--emit-module] - write the checked AST to the output file instead of building it, later compilations can take that module as input\n");
+	printf("\t[--time-report[=json]] - print the time and memory spent in every phase of the compilation\n");
+	fail();
 	
 }
 
-struct compilation_options parse_args(int argc, char** argv) {
+void parse_args(struct compilation_options* options, int argc, char** argv) {
 	
 	struct compilation_options opt = {0};
+	opt.inputs = options->inputs = malloc(argc * sizeof(const char*)); // stored right away, so it's freed if parsing fails
+	if(!opt.inputs) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
 	
 	for(int i = 1; i < argc; i++) {
 		
@@ -34,96 +81,371 @@ struct compilation_options parse_args(int argc, char** argv) {
 			opt.preserve = 1;
 			continue;
 		}
+		if(!strcmp("--cache-dir", argv[i])) {
+			i++;
+			if(i == argc) {
+				fprintf(stderr, "E: Expected directory after \"%s\"!\n", argv[i - 1]);
+				fail();
+			}
+			opt.cache_dir = argv[i];
+			continue;
+		}
+		if(!strcmp("--no-cache", argv[i])) {
+			opt.no_cache = 1;
+			continue;
+		}
+		if(!strcmp("-i", argv[i]) || !strcmp("--incremental", argv[i])) {
+			opt.incremental = 1;
+			continue;
+		}
+		if(!strcmp("-s", argv[i]) || !strcmp("--stats", argv[i])) {
+			opt.stats = 1;
+			continue;
+		}
+		if(!strncmp("-O", argv[i], 2)) {
+			if(strcmp("-O0", argv[i]) && strcmp("-O1", argv[i]) && strcmp("-O2", argv[i]) && strcmp("-O3", argv[i]) && strcmp("-Os", argv[i])) {
+				fprintf(stderr, "E: Unknown optimization level \"%s\"!\n", argv[i]);
+				fail();
+			}
+			opt.optimization = argv[i];
+			continue;
+		}
+		if(!strncmp("-march=", argv[i], 7)) {
+			if(!argv[i][7]) {
+				fprintf(stderr, "E: Expected architecture after \"-march=\"!\n");
+				fail();
+			}
+			opt.arch = argv[i];
+			continue;
+		}
+		if(!strcmp("-r", argv[i]) || !strcmp("--run", argv[i])) {
+			opt.run = 1;
+			continue;
+		}
+		if(!strcmp("--emit-module", argv[i])) {
+			opt.emit_module = 1;
+			continue;
+		}
+		if(!strcmp("--time-report", argv[i])) {
+			opt.time_report = REPORT_TEXT;
+			continue;
+		}
+		if(!strcmp("--time-report=json", argv[i])) {
+			opt.time_report = REPORT_JSON;
+			continue;
+		}
+		if(!strcmp("-b", argv[i]) || !strcmp("--backend", argv[i])) {
+			i++;
+			if(i == argc) {
+				fprintf(stderr, "E: Expected backend name after \"%s\"!\n", argv[i - 1]);
+				fail();
+			}
+			if(!strcmp("c", argv[i])) opt.backend = BACKEND_C;
+			else if(!strcmp("native", argv[i])) opt.backend = BACKEND_NATIVE;
+			else {
+				fprintf(stderr, "E: Unknown backend \"%s\"!\n", argv[i]);
+				fail();
+			}
+			continue;
+		}
+		if(!strcmp("-j", argv[i]) || !strcmp("--jobs", argv[i])) {
+			i++;
+			char* end;
+			long jobs = i < argc ? strtol(argv[i], &end, 10) : 0;
+			if(i == argc || !*argv[i] || *end || jobs < 1 || jobs > MAX_JOBS) {
+				fprintf(stderr, "E: Expected a number of jobs from 1 to %d after \"%s\"!\n", MAX_JOBS, argv[i - 1]);
+				fail();
+			}
+			opt.jobs = jobs;
+			continue;
+		}
+		if(!strcmp("--pgo-train", argv[i])) {
+			i++;
+			if(i == argc) {
+				fprintf(stderr, "E: Expected training command after \"%s\"!\n", argv[i - 1]);
+				fail();
+			}
+			opt.pgo_train = argv[i];
+			continue;
+		}
 		if(!strcmp("-o", argv[i]) || !strcmp("--output", argv[i])) {
 			if(opt.output) {
 				fprintf(stderr, "E: More than one output file specified!\n");
-				exit(1);
+				fail();
 			}
 			i++;
 			if(i == argc) {
 				fprintf(stderr, "E: Expected file name after \"%s\"!\n", argv[i - 1]);
-				exit(1);
+				fail();
 			}
 			opt.output = argv[i];
 			continue;
 		}
-		if(opt.input) {
-			fprintf(stderr, "E: More than one input file specified!\n");
-			exit(1);
+		if(!strcmp("-", argv[i])) {
+			for(size_t j = 0; j < opt.input_count; j++) {
+				if(!strcmp("-", opt.inputs[j])) {
+					fprintf(stderr, "E: stdin can only be read once!\n");
+					fail();
+				}
+			}
 		}
-		opt.input = argv[i];
+		opt.inputs[opt.input_count++] = argv[i];
 		
 	}
 	
-	if(!opt.input) {
+	if(!opt.input_count) {
 		fprintf(stderr, "E: No input file specified!\n");
-		exit(1);
+		fail();
+	}
+	if(opt.run && (opt.output || opt.incremental || opt.preserve || opt.emit_module || opt.optimization || opt.arch || opt.jobs || opt.backend != BACKEND_C)) {
+		fprintf(stderr, "E: Nothing is built with --run, it doesn't go with -o, a backend, -i, -p, -O, -march, -j or --emit-module!\n");
+		fail();
 	}
 	if(!opt.output) opt.output = DEFAULT_OUTPUT;
+	if(opt.incremental && opt.no_cache) {
+		fprintf(stderr, "E: Incremental compilation needs the cache!\n");
+		fail();
+	}
+	if(opt.incremental && opt.backend != BACKEND_C) {
+		fprintf(stderr, "E: Incremental compilation only works with the C backend!\n");
+		fail();
+	}
+	if((opt.optimization || opt.arch) && opt.backend != BACKEND_C) {
+		fprintf(stderr, "E: -O and -march only work with the C backend!\n");
+		fail();
+	}
+	if(opt.jobs && (opt.incremental || opt.backend != BACKEND_C)) {
+		fprintf(stderr, "E: -j only works with the C backend and without -i!\n");
+		fail();
+	}
+	if(opt.pgo_train && (opt.incremental || opt.no_cache || opt.run || opt.emit_module || opt.backend != BACKEND_C)) {
+		fprintf(stderr, "E: --pgo-train only works with the C backend and the cache, and without -i, --run or --emit-module!\n");
+		fail();
+	}
+	if(opt.pgo_train && !(opt.optimization && strcmp(opt.optimization, "-O0"))) {
+		fprintf(stderr, "W: gcc only makes use of the profile with -O1 or higher!\n");
+	}
+	if(opt.emit_module && (opt.incremental || opt.preserve || opt.jobs || opt.backend != BACKEND_C)) {
+		fprintf(stderr, "E: A module isn't built, --emit-module doesn't go with a backend, -i, -p or -j!\n");
+		fail();
+	}
 	
-	return opt;
+	*options = opt;
 	
 }
 
-char* slurp_file(const char* path) {
+int open_cache(struct compilation_options* opt, struct cache* cache) { // returns 1 if the cache can be used
 	
-	FILE* file = fopen(path, "r");
-	if(!file) {
-		fprintf(stderr, "E: Failed to open file \"%s\"!\n", path);
-		exit(1);
-	}
+	if(opt->no_cache) return 0;
+	if(opt->cache_dir) return !cache_init(cache, opt->cache_dir);
 	
-	fseek(file, 0, SEEK_END);
-	int size = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	char* dir = default_cache_dir();
+	if(!dir) return 0;
+	int ret = !cache_init(cache, dir);
+	free(dir);
+	return ret;
 	
-	char* data = malloc(size + 1);
-	if(!data) {
-		fclose(file);
-		fprintf(stderr, "E: Failed to allocate memory!\n");
-		exit(1);
-	}
+}
+
+struct build_options get_build_options(struct compilation_options* opt) {
+	
+	struct build_options options = {
+		.preserve = opt->preserve,
+		.optimization = opt->optimization,
+		.arch = opt->arch,
+		.units = opt->jobs,
+		.profile = 0, // build_pgo() adds the one it trains or uses
+	};
+	return options;
+	
+}
+
+void compute_cache_key(struct compilation_options* opt, struct source_file* files, char key[2 * SHA256_SIZE + 1]) {
 	
-	fread(data, size, 1, file);
-	fclose(file);
+	struct sha256 ctx;
+	sha256_init(&ctx);
 	
-	if(ferror(file)) {
-		fprintf(stderr, "E: Failed to read from file \"%s\"!\n", path);
-		exit(1);
+	sha256_update(&ctx, "caro " CARO_VERSION, sizeof("caro " CARO_VERSION));
+	sha256_update(&ctx, &opt->backend, sizeof(opt->backend));
+	if(opt->backend == BACKEND_C) {
+		struct build_options build_opt = get_build_options(opt);
+		hash_compiler(&ctx);
+		hash_build_options(&ctx, &build_opt);
+		int pgo = !!opt->pgo_train; // the profile is cached apart, under compute_profile_key()
+		sha256_update(&ctx, &pgo, sizeof(pgo));
 	}
+	hash_files(files, opt->input_count, &ctx);
 	
-	data[size] = 0;
+	unsigned char digest[SHA256_SIZE];
+	sha256_final(&ctx, digest);
+	sha256_hex(digest, key);
 	
-	return data;
+}
+
+void compute_profile_key(struct compilation_options* opt, struct source_file* files, char key[2 * SHA256_SIZE + 1]) {
+	
+	// the counters have to match the code gcc sees, which only depends on the sources, the flags and the units;
+	// the training command doesn't count, a profile is reused whatever trained it
+	struct sha256 ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, "caro profile " CARO_VERSION, sizeof("caro profile " CARO_VERSION));
+	struct build_options build_opt = get_build_options(opt);
+	hash_compiler(&ctx);
+	hash_build_options(&ctx, &build_opt); // only says whether the program is split, not into how many units
+	size_t units = opt->jobs > 1 ? opt->jobs : 1; // -j 1 builds like no -j at all
+	sha256_update(&ctx, &units, sizeof(units));
+	hash_files(files, opt->input_count, &ctx);
+	
+	unsigned char digest[SHA256_SIZE];
+	sha256_final(&ctx, digest);
+	sha256_hex(digest, key);
 	
 }
 
-void build(struct ast* ast, const char* path, int preserve) {
+void compute_module_hash(struct compilation_options* opt, struct source_file* files, unsigned char hash[SHA256_SIZE]) {
 	
-	int size = snprintf(0, 0, "%s.c", path);
-	char p[size + 1];
-	snprintf(p, size + 1, "%s.c", path);
+	struct sha256 ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, "caro module " CARO_VERSION, sizeof("caro module " CARO_VERSION));
+	hash_files(files, opt->input_count, &ctx);
+	sha256_final(&ctx, hash);
+	
+}
+
+struct compilation {
+	struct compilation_options opt;
+	struct source_file* files;
+	size_t file_count;
+	struct cache cache;
+};
+
+void free_compilation(void* arg) {
 	
-	generate_c(ast, p);
+	struct compilation* comp = arg;
+	free_files(comp->files, comp->file_count);
+	free(comp->files);
+	free(comp->opt.inputs);
+	cache_free(&comp->cache);
 	
-	size = snprintf(0, 0, "gcc %s -o %s", p, path);
-	char cmd[size + 1];
-	snprintf(cmd, size + 1, "gcc %s -o %s", p, path);
+}
+
+void finish_compilation(enum report_format format) { // runs the cleanup pushed by compile(), which also frees the options
 	
-	int ret = system(cmd);
-	if(!preserve) remove(p);
-	if(ret) exit(1);
+	report_begin(PHASE_CLEANUP);
+	pop_cleanup(1);
+	report_end(PHASE_CLEANUP);
+	print_report(format);
 	
 }
 
-/// TODO: check ast before generating c code (e.g. for invalid variables)
+int compile(int argc, char** argv) { // everything it allocates is released on success and through fail() alike
+	
+	struct compilation comp = {0};
+	struct compilation_options* opt = &comp.opt;
+	push_cleanup(free_compilation, &comp);
+	
+	parse_args(opt, argc, argv);
+	
+	comp.files = calloc(opt->input_count, sizeof(struct source_file));
+	if(!comp.files) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	comp.file_count = opt->input_count;
+	report_reset(opt->time_report != REPORT_NONE);
+	report_begin(PHASE_READ);
+	for(size_t i = 0; i < opt->input_count; i++) {
+		comp.files[i].path = opt->inputs[i];
+		comp.files[i].source = read_source(opt->inputs[i]);
+	}
+	report_end(PHASE_READ);
+	
+	int have_cache = open_cache(opt, &comp.cache);
+	if((opt->incremental || opt->pgo_train) && !have_cache) {
+		fprintf(stderr, "E: Incremental compilation and --pgo-train need the cache!\n");
+		fail();
+	}
+	
+	// --preserve wants the generated C code, which a cache hit wouldn't produce, and modules and runs aren't cached
+	int use_cache = have_cache && !opt->preserve && !opt->emit_module && !opt->run;
+	char key[2 * SHA256_SIZE + 1];
+	if(use_cache) {
+		report_begin(PHASE_CACHE);
+		compute_cache_key(opt, comp.files, key);
+		int hit = cache_fetch(&comp.cache, key, opt->output);
+		report_end(PHASE_CACHE);
+		if(hit) {
+			finish_compilation(opt->time_report);
+			return 0;
+		}
+	}
+	
+	report_begin(PHASE_TOKENIZE);
+	tokenize_files(comp.files, comp.file_count);
+	report_end(PHASE_TOKENIZE);
+	report_begin(PHASE_PARSE);
+	parse_files(comp.files, comp.file_count);
+	struct ast* ast = merge_files(comp.files, comp.file_count);
+	report_end(PHASE_PARSE);
+	if(comp.file_count > 1 || !comp.files[0].module) { // a module was resolved and optimized before it was written
+		report_begin(PHASE_RESOLVE);
+		resolve(ast);
+		report_end(PHASE_RESOLVE);
+		report_begin(PHASE_OPTIMIZE);
+		optimize(ast);
+		report_end(PHASE_OPTIMIZE);
+	}
+	for(size_t i = 0; i < comp.file_count; i++) report.tokens += comp.files[i].token_count;
+	report.nodes = ast->node_count;
+	
+	int status = 0;
+	if(opt->run) status = interpret(ast);
+	else if(opt->emit_module) {
+		report_begin(PHASE_GENERATE);
+		unsigned char hash[SHA256_SIZE];
+		compute_module_hash(opt, comp.files, hash);
+		write_module(ast, hash, opt->output);
+		report_end(PHASE_GENERATE);
+	}
+	else if(opt->backend == BACKEND_NATIVE) {
+		report_begin(PHASE_GENERATE);
+		build_native(ast, opt->output);
+		report_end(PHASE_GENERATE);
+	}
+	else {
+		struct build_options build_opt = get_build_options(opt);
+		if(opt->incremental) build_incremental(ast, opt->output, &build_opt, &comp.cache);
+		else if(opt->pgo_train) {
+			char profile_key[2 * SHA256_SIZE + 1];
+			compute_profile_key(opt, comp.files, profile_key);
+			build_pgo(ast, opt->output, &build_opt, opt->pgo_train, &comp.cache, profile_key);
+		}
+		else build(ast, opt->output, &build_opt);
+	}
+	if(use_cache) {
+		report_begin(PHASE_CACHE);
+		cache_store(&comp.cache, key, opt->output);
+		report_end(PHASE_CACHE);
+	}
+	
+	if(opt->stats) fprintf(stderr, "I: AST: %u nodes in %zu bytes\n", ast->node_count, ast_memory(ast));
+	
+	finish_compilation(opt->time_report);
+	return status;
+	
+}
 
 int main(int argc, char** argv) {
 	
-	struct compilation_options opt = parse_args(argc, argv);
-	char* source = slurp_file(opt.input);
-	struct token* tokens = tokenize(source);
-	struct ast* ast = parse(tokens);
-	build(ast, opt.output, opt.preserve);
+	if(argc > 1 && (!strcmp("--server", argv[1]) || !strcmp("--connect", argv[1]))) {
+		if(argc == 2) {
+			fprintf(stderr, "E: Expected socket path after \"%s\"!\n", argv[1]);
+			return 1;
+		}
+		if(!strcmp("--server", argv[1])) return run_server(argv[2], compile);
+		return run_client(argv[2], argc - 2, argv + 2); // the socket path takes the place of argv[0]
+	}
+	
+	return compile(argc, argv);
 	
 }
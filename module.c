@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "module.h"
+#include "buffer.h"
+#include "error.h"
+
+struct module_layout { // offsets of the arrays in the file
+	size_t types;
+	size_t operators;
+	size_t lhs;
+	size_t rhs;
+	size_t lists;
+	size_t functions;
+	size_t strings;
+	size_t string_table;
+	size_t size; // of the whole file
+};
+
+size_t next_section(size_t* offset, size_t size) { // returns the offset for size bytes and moves past them
+	
+	size_t section = *offset;
+	*offset = (section + size + 7) & ~(size_t)7;
+	return section;
+	
+}
+
+struct module_layout get_module_layout(const struct module_header* header) {
+	
+	struct module_layout layout;
+	size_t offset = sizeof(struct module_header);
+	layout.types = next_section(&offset, header->node_count * sizeof(uint8_t));
+	layout.operators = next_section(&offset, header->node_count * sizeof(uint8_t));
+	layout.lhs = next_section(&offset, (size_t)header->node_count * sizeof(uint32_t));
+	layout.rhs = next_section(&offset, (size_t)header->node_count * sizeof(uint32_t));
+	layout.lists = next_section(&offset, (size_t)header->list_size * sizeof(uint32_t));
+	layout.functions = next_section(&offset, (size_t)header->function_count * sizeof(struct function));
+	layout.strings = next_section(&offset, header->string_size);
+	layout.string_table = next_section(&offset, (size_t)header->string_table_size * sizeof(struct string_slot));
+	layout.size = offset;
+	return layout;
+	
+}
+
+int section_fits(size_t offset, size_t size, size_t file_size) {
+	
+	return offset <= file_size && size <= file_size - offset;
+	
+}
+
+int is_string(struct ast* ast, uint32_t offset) { // the offset has to be where one of the strings starts
+	
+	return offset < ast->string_size && (!offset || !ast->strings[offset - 1]);
+	
+}
+
+int check_list(struct ast* ast, uint32_t list, uint32_t first, uint32_t end) { // every statement in first to end - 1
+	
+	if(list >= ast->list_size || ast->lists[list] >= ast->list_size - list) return 0;
+	for(uint32_t i = 1; i <= ast->lists[list]; i++) {
+		if(ast->lists[list + i] < first || ast->lists[list + i] >= end) return 0;
+	}
+	return 1;
+	
+}
+
+// Checks every index in the AST of a module, so a broken one can't make the later passes read outside of it or loop.
+// Operands come before their expressions and function bodies after their declarations, which rules out cycles.
+int check_module_ast(struct ast* ast) {
+	
+	for(uint32_t node = 0; node < ast->node_count; node++) {
+		uint32_t lhs = ast->lhs[node], rhs = ast->rhs[node];
+		switch(ast->types[node]) {
+		case NUMERIC_LITERAL:
+			if(ast->operators[node] > LITERAL_64_UNSIGNED) return 0;
+			break;
+		case IDENTIFIER:
+			if(!is_string(ast, lhs)) return 0;
+			break;
+		case BINARY_EXPRESSION:
+			if(ast->operators[node] > OP_AND || lhs >= node || rhs >= node) return 0;
+			break;
+		case FUNCTION_DECLARATION: {
+			if(lhs >= ast->function_count) return 0;
+			struct function* function = &ast->functions[lhs];
+			if(function->end <= node || function->end > ast->node_count || !check_list(ast, function->body, node + 1, function->end)) return 0;
+			if(!is_string(ast, function->name) || !is_string(ast, function->symbol) || !is_string(ast, function->return_type)) return 0;
+			break;
+		}
+		case RETURN_STATEMENT:
+			if(lhs != NO_NODE && lhs >= ast->node_count) return 0;
+			break;
+		default:
+			return 0;
+		}
+	}
+	
+	// merge_files() walks the lists in order and expects the top-level one last
+	uint32_t list = 0;
+	while(list < ast->body) {
+		if(!check_list(ast, list, 0, ast->node_count)) return 0;
+		list += ast->lists[list] + 1;
+	}
+	if(list != ast->body || !check_list(ast, list, 0, ast->node_count) || ast->lists[list] + 1 != ast->list_size - list) return 0;
+	
+	for(uint32_t i = 0; i < ast->string_table_size; i++) {
+		if(ast->string_table[i].offset && !is_string(ast, ast->string_table[i].offset - 1)) return 0;
+	}
+	return 1;
+	
+}
+
+int is_module(struct source* source) {
+	
+	return source->size >= sizeof(struct module_header) && !memcmp(source->data, MODULE_MAGIC, sizeof(MODULE_MAGIC));
+	
+}
+
+struct ast* load_module(struct source* source, const char* path) {
+	
+	const struct module_header* header = (const struct module_header*)source->data;
+	if(header->version != MODULE_VERSION) {
+		fprintf(stderr, "E: \"%s\" is a module of another version of caro, it has to be rebuilt!\n", path);
+		fail();
+	}
+	
+	// a truncated or corrupt module mustn't make anything read outside of the mapping, so every section is checked
+	// against the file before it's used, and every index in them once the AST points into it
+	struct module_layout layout = get_module_layout(header);
+	size_t file_size = source->size;
+	int broken = layout.size != file_size
+		|| !section_fits(layout.types, header->node_count * sizeof(uint8_t), file_size)
+		|| !section_fits(layout.operators, header->node_count * sizeof(uint8_t), file_size)
+		|| !section_fits(layout.lhs, (size_t)header->node_count * sizeof(uint32_t), file_size)
+		|| !section_fits(layout.rhs, (size_t)header->node_count * sizeof(uint32_t), file_size)
+		|| !section_fits(layout.lists, (size_t)header->list_size * sizeof(uint32_t), file_size)
+		|| !section_fits(layout.functions, (size_t)header->function_count * sizeof(struct function), file_size)
+		|| !section_fits(layout.strings, header->string_size, file_size)
+		|| !section_fits(layout.string_table, (size_t)header->string_table_size * sizeof(struct string_slot), file_size);
+	if(broken || header->body >= header->list_size || (header->string_size && source->data[layout.strings + header->string_size - 1])
+		|| header->string_table_size & (header->string_table_size - 1) || (uint64_t)header->string_count * 2 > header->string_table_size) {
+		fprintf(stderr, "E: Module \"%s\" is broken!\n", path);
+		fail();
+	}
+	
+	struct ast* ast = calloc(1, sizeof(struct ast));
+	if(!ast) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	ast->mapped = 1;
+	ast->types = (uint8_t*)(source->data + layout.types);
+	ast->operators = (uint8_t*)(source->data + layout.operators);
+	ast->lhs = (uint32_t*)(source->data + layout.lhs);
+	ast->rhs = (uint32_t*)(source->data + layout.rhs);
+	ast->node_count = ast->node_capacity = header->node_count;
+	ast->lists = (uint32_t*)(source->data + layout.lists);
+	ast->list_size = ast->list_capacity = header->list_size;
+	ast->functions = (struct function*)(source->data + layout.functions);
+	ast->function_count = ast->function_capacity = header->function_count;
+	ast->strings = source->data + layout.strings;
+	ast->string_size = ast->string_capacity = header->string_size;
+	ast->string_table = (struct string_slot*)(source->data + layout.string_table);
+	ast->string_table_size = header->string_table_size;
+	ast->string_count = header->string_count;
+	ast->body = header->body;
+	if(!check_module_ast(ast)) {
+		free(ast);
+		fprintf(stderr, "E: Module \"%s\" is broken!\n", path);
+		fail();
+	}
+	return ast;
+	
+}
+
+void append_section(struct buffer* out, size_t offset, const void* data, size_t size) { // pads up to offset first
+	
+	buffer_reserve(out, offset - out->size);
+	memset(out->data + out->size, 0, offset - out->size);
+	out->size = offset;
+	if(size) buffer_append(out, data, size);
+	
+}
+
+struct string_slot* compact_string_table(struct ast* ast, uint32_t* size) { // the AST's table is usually much emptier than it has to be
+	
+	*size = ast->string_count ? 16 : 0;
+	while(*size && *size / 2 <= ast->string_count) *size *= 2; // the next intern_string() would grow it at half full
+	struct string_slot* table = calloc(*size ? *size : 1, sizeof(struct string_slot));
+	if(!table) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	
+	for(uint32_t i = 0; i < ast->string_table_size; i++) {
+		if(!ast->string_table[i].offset) continue;
+		uint32_t slot = ast->string_table[i].hash & (*size - 1);
+		while(table[slot].offset) slot = (slot + 1) & (*size - 1);
+		table[slot] = ast->string_table[i];
+	}
+	return table;
+	
+}
+
+void write_module(struct ast* ast, const unsigned char hash[SHA256_SIZE], const char* path) {
+	
+	uint32_t table_size;
+	struct string_slot* table = compact_string_table(ast, &table_size);
+	push_cleanup(free, table);
+	
+	struct module_header header = {MODULE_MAGIC, MODULE_VERSION};
+	header.node_count = ast->node_count;
+	header.list_size = ast->list_size;
+	header.function_count = ast->function_count;
+	header.string_size = ast->string_size;
+	header.string_table_size = table_size;
+	header.string_count = ast->string_count;
+	header.body = ast->body;
+	memcpy(header.hash, hash, SHA256_SIZE);
+	struct module_layout layout = get_module_layout(&header);
+	
+	struct buffer file = {0};
+	push_cleanup(buffer_cleanup, &file);
+	buffer_reserve(&file, layout.size);
+	buffer_append(&file, (const char*)&header, sizeof(header));
+	append_section(&file, layout.types, ast->types, ast->node_count * sizeof(uint8_t));
+	append_section(&file, layout.operators, ast->operators, ast->node_count * sizeof(uint8_t));
+	append_section(&file, layout.lhs, ast->lhs, (size_t)ast->node_count * sizeof(uint32_t));
+	append_section(&file, layout.rhs, ast->rhs, (size_t)ast->node_count * sizeof(uint32_t));
+	append_section(&file, layout.lists, ast->lists, (size_t)ast->list_size * sizeof(uint32_t));
+	append_section(&file, layout.functions, ast->functions, (size_t)ast->function_count * sizeof(struct function));
+	append_section(&file, layout.strings, ast->strings, ast->string_size);
+	append_section(&file, layout.string_table, table, (size_t)table_size * sizeof(struct string_slot));
+	append_section(&file, layout.size, 0, 0);
+	
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd < 0) {
+		fprintf(stderr, "E: Failed to open/create file \"%s\"!\n", path);
+		fail();
+	}
+	if(buffer_write(&file, fd)) {
+		fprintf(stderr, "E: Failed to write to file \"%s\"!\n", path);
+		close(fd);
+		fail();
+	}
+	close(fd);
+	
+	pop_cleanup(1); // file
+	pop_cleanup(1); // table
+	
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "input.h"
+#include "parser.h"
+#include "sha256.h"
+
+// A module is the resolved AST of some source files, written by --emit-module. The file is a header followed by the
+// AST's arrays, each one at a multiple of 8 bytes, in the byte order of the machine that wrote it. Nodes, lists and
+// strings only refer to each other by index, so loading a module is checking those indices and pointing an AST at the
+// mapped file.
+
+#define MODULE_MAGIC "caromod" // 8 bytes with the NUL
+#define MODULE_VERSION 1 // of the layout and the meaning of the AST, a module of another version has to be rebuilt
+
+struct module_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t node_count;
+	uint32_t list_size;
+	uint32_t function_count;
+	uint32_t string_size;
+	uint32_t string_table_size;
+	uint32_t string_count;
+	uint32_t body;
+	unsigned char hash[SHA256_SIZE]; // of the compiler version and the sources, stands in for the whole module in cache keys
+};
+
+int is_module(struct source* source);
+struct ast* load_module(struct source* source, const char* path); // the AST points into source, which has to outlive it
+void write_module(struct ast* ast, const unsigned char hash[SHA256_SIZE], const char* path);
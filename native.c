@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "native.h"
+#include "buffer.h"
+#include "error.h"
+
+#define LOAD_ADDRESS 0x400000
+#define CODE_OFFSET (sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr)) // the code directly follows the headers in the only segment
+
+struct native_function {
+	const char* name;
+	size_t offset;
+};
+
+struct native_generator {
+	struct buffer code;
+	struct native_function* functions;
+	size_t function_count;
+	size_t function_capacity;
+	struct buffer stack; // frames of emit_native_expression()
+};
+
+struct expression_frame {
+	uint32_t node;
+	uint32_t state; // 1 while the left operand is evaluated, 2 while the right one is
+};
+
+void emit_bytes(struct native_generator* gen, const char* bytes, size_t size) {
+	
+	buffer_append(&gen->code, bytes, size);
+	
+}
+
+void emit_imm32(struct native_generator* gen, int32_t imm) {
+	
+	uint32_t value = imm;
+	char bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+	emit_bytes(gen, bytes, 4);
+	
+}
+
+void emit_native_operator(struct native_generator* gen, enum binary_operation operator) { // eax = eax operator ecx
+	
+	switch(operator) {
+	case OP_ADD:
+		emit_bytes(gen, "\x01\xc8", 2); // add eax, ecx
+		break;
+	case OP_SUBTRACT:
+		emit_bytes(gen, "\x29\xc8", 2); // sub eax, ecx
+		break;
+	case OP_MULTIPLY:
+		emit_bytes(gen, "\x0f\xaf\xc1", 3); // imul eax, ecx
+		break;
+	case OP_DIVIDE:
+		emit_bytes(gen, "\x99\xf7\xf9", 3); // cdq; idiv ecx
+		break;
+	case OP_MODULO:
+		emit_bytes(gen, "\x99\xf7\xf9\x89\xd0", 5); // cdq; idiv ecx; mov eax, edx
+		break;
+	case OP_SHIFT_LEFT:
+		emit_bytes(gen, "\xd3\xe0", 2); // shl eax, cl
+		break;
+	case OP_SHIFT_RIGHT:
+		emit_bytes(gen, "\x48\x63\xc0\x48\xd3\xe8", 6); // movsxd rax, eax; shr rax, cl
+		break;
+	case OP_AND:
+		emit_bytes(gen, "\x21\xc8", 2); // and eax, ecx
+		break;
+	}
+	
+}
+
+int fits_imm32(struct ast* ast, uint32_t node) { // by value, folding can leave a small result in a 64-bit literal
+	
+	uint64_t value = literal_value(ast, node);
+	if(ast->operators[node] == LITERAL_64_UNSIGNED) return value <= INT32_MAX;
+	return (int64_t)value >= INT32_MIN && (int64_t)value <= INT32_MAX; // signed widths are sign-extended
+	
+}
+
+// Leaves the result in eax. The expression is walked with an explicit stack of frames, the native stack
+// of the compiler doesn't grow with its depth (the one of the compiled program still does).
+void emit_native_expression(struct native_generator* gen, struct ast* ast, uint32_t expr) {
+	
+	struct expression_frame frame = {expr, 0};
+	buffer_append(&gen->stack, (const char*)&frame, sizeof(frame));
+	
+	while(gen->stack.size) {
+		
+		struct expression_frame* top = (struct expression_frame*)(gen->stack.data + gen->stack.size) - 1;
+		uint32_t node = top->node;
+		
+		switch(ast->types[node]) {
+		case NUMERIC_LITERAL:
+			if(!fits_imm32(ast, node)) {
+				fprintf(stderr, "E: The native backend only supports integer literals that fit into 32 bits (%lu)!\n", (unsigned long)literal_value(ast, node));
+				fail();
+			}
+			emit_bytes(gen, "\xb8", 1); // mov eax, imm32
+			emit_imm32(gen, ast->lhs[node]);
+			gen->stack.size -= sizeof(frame);
+			break;
+		case BINARY_EXPRESSION: {
+			uint32_t right = ast->rhs[node];
+			if(top->state == 0) { // evaluate the left operand first
+				top->state = 1;
+				frame.node = ast->lhs[node];
+				buffer_append(&gen->stack, (const char*)&frame, sizeof(frame));
+				break;
+			}
+			if(top->state == 1) {
+				if(ast->types[right] == NUMERIC_LITERAL && fits_imm32(ast, right)) { // no need to save eax for a constant
+					emit_bytes(gen, "\xb9", 1); // mov ecx, imm32
+					emit_imm32(gen, ast->lhs[right]);
+				} else {
+					emit_bytes(gen, "\x50", 1); // push rax
+					top->state = 2;
+					frame.node = right;
+					buffer_append(&gen->stack, (const char*)&frame, sizeof(frame));
+					break;
+				}
+			} else {
+				emit_bytes(gen, "\x89\xc1\x58", 3); // mov ecx, eax; pop rax
+			}
+			emit_native_operator(gen, ast->operators[node]);
+			gen->stack.size -= sizeof(frame);
+			break;
+		}
+		case IDENTIFIER:
+			fprintf(stderr, "E: The native backend doesn't support identifiers in expressions (\"%s\")!\n", ast->strings + ast->lhs[node]);
+			fail();
+		default:
+			fprintf(stderr, "Unimplemented expression: %d\n", ast->types[node]);
+			fail();
+		}
+		
+	}
+	
+}
+
+void emit_native_function(struct native_generator* gen, struct ast* ast, uint32_t func) {
+	
+	struct function* function = &ast->functions[ast->lhs[func]];
+	uint32_t* body = &ast->lists[function->body];
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		if(ast->types[body[i]] == FUNCTION_DECLARATION) emit_native_function(gen, ast, body[i]);
+	}
+	
+	if(gen->function_count == gen->function_capacity) {
+		gen->function_capacity = gen->function_capacity ? gen->function_capacity * 2 : 16;
+		gen->functions = realloc(gen->functions, gen->function_capacity * sizeof(struct native_function));
+		if(!gen->functions) {
+			fprintf(stderr, "E: Failed to allocate memory!\n");
+			fail();
+		}
+	}
+	gen->functions[gen->function_count].name = ast->strings + function->symbol;
+	gen->functions[gen->function_count].offset = gen->code.size;
+	gen->function_count++;
+	
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		uint32_t stmt = body[i];
+		switch(ast->types[stmt]) {
+		case FUNCTION_DECLARATION:
+			break;
+		case RETURN_STATEMENT:
+			if(ast->lhs[stmt] != NO_NODE) emit_native_expression(gen, ast, ast->lhs[stmt]);
+			emit_bytes(gen, "\xc3", 1); // ret
+			break;
+		default: // expression statement, evaluated for its traps only
+			emit_native_expression(gen, ast, stmt);
+			break;
+		}
+	}
+	
+	emit_bytes(gen, "\x31\xc0\xc3", 3); // xor eax, eax; ret (falling off the end returns 0)
+	
+}
+
+void free_native_generator(void* arg) {
+	
+	struct native_generator* gen = arg;
+	buffer_free(&gen->code);
+	buffer_free(&gen->stack);
+	free(gen->functions);
+	
+}
+
+void build_native(struct ast* ast, const char* path) {
+	
+	struct native_generator gen = {0};
+	push_cleanup(free_native_generator, &gen);
+	
+	// _start: call main; mov edi, eax; mov eax, 60 (SYS_exit); syscall
+	emit_bytes(&gen, "\xe8\0\0\0\0\x89\xc7\xb8\x3c\0\0\0\x0f\x05", 14);
+	
+	uint32_t* body = &ast->lists[ast->body];
+	for(uint32_t i = 1; i <= body[0]; i++) {
+		if(ast->types[body[i]] != FUNCTION_DECLARATION) {
+			fprintf(stderr, "E: Only functions are allowed at the top level!\n");
+			fail();
+		}
+		emit_native_function(&gen, ast, body[i]);
+	}
+	
+	struct native_function* main_function = 0;
+	for(size_t i = 0; i < gen.function_count; i++) {
+		if(!strcmp(gen.functions[i].name, "main")) main_function = &gen.functions[i];
+	}
+	if(!main_function) {
+		fprintf(stderr, "E: No main function!\n");
+		fail();
+	}
+	int32_t rel = main_function->offset - 5; // relative to the end of the call instruction
+	memcpy(gen.code.data + 1, &rel, 4);
+	
+	Elf64_Ehdr header = {0};
+	memcpy(header.e_ident, ELFMAG, SELFMAG);
+	header.e_ident[EI_CLASS] = ELFCLASS64;
+	header.e_ident[EI_DATA] = ELFDATA2LSB;
+	header.e_ident[EI_VERSION] = EV_CURRENT;
+	header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	header.e_type = ET_EXEC;
+	header.e_machine = EM_X86_64;
+	header.e_version = EV_CURRENT;
+	header.e_entry = LOAD_ADDRESS + CODE_OFFSET;
+	header.e_phoff = sizeof(Elf64_Ehdr);
+	header.e_ehsize = sizeof(Elf64_Ehdr);
+	header.e_phentsize = sizeof(Elf64_Phdr);
+	header.e_phnum = 1;
+	
+	Elf64_Phdr segment = {0};
+	segment.p_type = PT_LOAD;
+	segment.p_flags = PF_R | PF_X;
+	segment.p_offset = 0;
+	segment.p_vaddr = LOAD_ADDRESS;
+	segment.p_paddr = LOAD_ADDRESS;
+	segment.p_filesz = CODE_OFFSET + gen.code.size;
+	segment.p_memsz = CODE_OFFSET + gen.code.size;
+	segment.p_align = 0x1000;
+	
+	struct buffer file = {0};
+	push_cleanup(buffer_cleanup, &file);
+	buffer_append(&file, (const char*)&header, sizeof(header));
+	buffer_append(&file, (const char*)&segment, sizeof(segment));
+	buffer_append(&file, gen.code.data, gen.code.size);
+	
+	struct stat st;
+	if(!lstat(path, &st) && S_ISREG(st.st_mode)) unlink(path); // an existing file would keep its old permissions
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	if(fd < 0) {
+		fprintf(stderr, "E: Failed to open/create file \"%s\"!\n", path);
+		fail();
+	}
+	if(buffer_write(&file, fd)) {
+		fprintf(stderr, "E: Failed to write to file \"%s\"!\n", path);
+		close(fd);
+		fail();
+	}
+	close(fd);
+	
+	pop_cleanup(1); // file
+	pop_cleanup(1); // gen
+	
+}
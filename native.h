@@ -0,0 +1,4 @@
+#pragma once
+#include "parser.h"
+
+void build_native(struct ast* ast, const char* path); // writes a static x86-64 ELF executable without going through gcc
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "optimize.h"
+#include "buffer.h"
+#include "error.h"
+
+#define UNKNOWN_WIDTH 0xff // of expressions with identifiers, nothing declares values yet
+
+struct optimizer {
+	struct ast* ast;
+	uint8_t* widths; // enum literal_width of the C type of every expression that has been simplified already
+	struct buffer functions; // the declarations around the current node, innermost last
+	int warned; // about overflow, once per function is enough
+	struct function* warned_in;
+	int failed;
+};
+
+struct function* current_function(struct optimizer* o) { // NULL at the top level
+	
+	if(!o->functions.size) return 0;
+	uint32_t node = ((uint32_t*)(o->functions.data + o->functions.size))[-1];
+	return &o->ast->functions[o->ast->lhs[node]];
+	
+}
+
+void print_location(struct optimizer* o) { // finishes a message about the current node
+	
+	struct function* function = current_function(o);
+	if(function) fprintf(stderr, " in function \"%s\" in line %d!\n", o->ast->strings + function->name, function->line);
+	else fprintf(stderr, " at the top level!\n");
+	
+}
+
+void set_literal(struct ast* ast, uint32_t node, uint64_t value, enum literal_width width) { // values of signed widths are sign-extended
+	
+	ast->types[node] = NUMERIC_LITERAL;
+	ast->operators[node] = width;
+	ast->lhs[node] = (uint32_t)value;
+	ast->rhs[node] = value >> 32;
+	
+}
+
+void replace_node(struct ast* ast, uint32_t node, uint32_t with) { // the parent keeps its index, with isn't referenced anymore
+	
+	ast->types[node] = ast->types[with];
+	ast->operators[node] = ast->operators[with];
+	ast->lhs[node] = ast->lhs[with];
+	ast->rhs[node] = ast->rhs[with];
+	
+}
+
+int power_of_two(uint64_t value) { // the exponent, or -1
+	
+	return value && !(value & (value - 1)) ? __builtin_ctzll(value) : -1;
+	
+}
+
+// Both operands get converted to the wider width first, like C does: the ranks of int, long and unsigned long are in
+// the order of enum literal_width.
+void fold_constants(struct optimizer* o, uint32_t node) {
+	
+	struct ast* ast = o->ast;
+	uint32_t left = ast->lhs[node];
+	uint32_t right = ast->rhs[node];
+	enum literal_width width = ast->operators[left] > ast->operators[right] ? ast->operators[left] : ast->operators[right];
+	uint64_t a = literal_value(ast, left);
+	uint64_t b = literal_value(ast, right);
+	enum binary_operation operation = ast->operators[node];
+	
+	if((operation == OP_DIVIDE || operation == OP_MODULO) && !b) {
+		fprintf(stderr, "E: Division by zero");
+		print_location(o);
+		o->failed = 1;
+		return;
+	}
+	
+	uint64_t result;
+	if(width == LITERAL_64_UNSIGNED) { // wraps around, as it should
+		switch(operation) {
+		case OP_ADD: result = a + b; break;
+		case OP_SUBTRACT: result = a - b; break;
+		case OP_MULTIPLY: result = a * b; break;
+		case OP_DIVIDE: result = a / b; break;
+		case OP_MODULO: result = a % b; break;
+		default: return; // shifts and masks always have an operand that isn't constant
+		}
+	} else {
+		__int128 x = (int64_t)a;
+		__int128 y = (int64_t)b;
+		__int128 exact;
+		switch(operation) {
+		case OP_ADD: exact = x + y; break;
+		case OP_SUBTRACT: exact = x - y; break;
+		case OP_MULTIPLY: exact = x * y; break;
+		case OP_DIVIDE:
+		case OP_MODULO: exact = x / y; break; // C leaves the remainder undefined when the quotient overflows
+		default: return;
+		}
+		__int128 min = width == LITERAL_32 ? INT32_MIN : INT64_MIN;
+		__int128 max = width == LITERAL_32 ? INT32_MAX : INT64_MAX;
+		if((exact < min || exact > max) && !(o->warned && o->warned_in == current_function(o))) {
+			fprintf(stderr, "W: Integer overflow in constant expressions, the results wrap around");
+			print_location(o);
+			o->warned = 1;
+			o->warned_in = current_function(o);
+		}
+		result = operation == OP_MODULO ? (uint64_t)(x % y) : (uint64_t)exact;
+		if(width == LITERAL_32) result = (int32_t)result;
+	}
+	set_literal(ast, node, result, width);
+	
+}
+
+// The C type the generated code gives an expression, from the ones of its operands.
+uint8_t expression_width(struct optimizer* o, uint32_t node) {
+	
+	struct ast* ast = o->ast;
+	if(ast->types[node] == NUMERIC_LITERAL) return ast->operators[node];
+	if(ast->types[node] != BINARY_EXPRESSION) return UNKNOWN_WIDTH;
+	uint8_t left = o->widths[ast->lhs[node]];
+	uint8_t right = o->widths[ast->rhs[node]];
+	if(left == UNKNOWN_WIDTH || right == UNKNOWN_WIDTH) return UNKNOWN_WIDTH;
+	if(ast->operators[node] == OP_SHIFT_LEFT) return left;
+	if(ast->operators[node] == OP_SHIFT_RIGHT) return LITERAL_64_UNSIGNED; // of the left operand converted to u64
+	return left > right ? left : right;
+	
+}
+
+// Only an int constant leaves the type of the other operand alone, after integer promotion. Expressions don't have
+// side effects, so x * 0 doesn't have to keep x, only its type.
+void simplify(struct optimizer* o, uint32_t node) {
+	
+	struct ast* ast = o->ast;
+	int constant_left = ast->types[ast->lhs[node]] == NUMERIC_LITERAL;
+	uint32_t constant = constant_left ? ast->lhs[node] : ast->rhs[node];
+	uint32_t other = constant_left ? ast->rhs[node] : ast->lhs[node];
+	uint64_t value = literal_value(ast, constant);
+	enum binary_operation operation = ast->operators[node];
+	if(constant_left && operation != OP_ADD && operation != OP_MULTIPLY) return;
+	
+	if(ast->operators[constant] == LITERAL_32) {
+		if((!value && (operation == OP_ADD || operation == OP_SUBTRACT)) || (value == 1 && (operation == OP_MULTIPLY || operation == OP_DIVIDE))) {
+			replace_node(ast, node, other);
+		} else if(!value && operation == OP_MULTIPLY && o->widths[other] != UNKNOWN_WIDTH) {
+			set_literal(ast, node, 0, o->widths[other]);
+		} else if(operation == OP_MULTIPLY && power_of_two(value) > 0) { // gcc defines << of negative values as multiplication
+			ast->operators[node] = OP_SHIFT_LEFT;
+			ast->lhs[node] = other;
+			ast->rhs[node] = constant;
+			set_literal(ast, constant, power_of_two(value), LITERAL_32);
+		}
+		return;
+	}
+	
+	// a signed x / 2^k rounds towards zero and a shift doesn't, but an unsigned constant makes the division unsigned
+	if(ast->operators[constant] == LITERAL_64_UNSIGNED && power_of_two(value) >= 0) {
+		if(operation == OP_DIVIDE) {
+			ast->operators[node] = OP_SHIFT_RIGHT;
+			set_literal(ast, constant, power_of_two(value), LITERAL_32);
+		} else if(operation == OP_MODULO) {
+			ast->operators[node] = OP_AND;
+			set_literal(ast, constant, value - 1, LITERAL_64_UNSIGNED);
+		}
+	}
+	
+}
+
+void optimize(struct ast* ast) {
+	
+	struct optimizer o = {ast};
+	push_cleanup(buffer_cleanup, &o.functions);
+	o.widths = malloc(ast->node_count ? ast->node_count : 1);
+	if(!o.widths) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	push_cleanup(free, o.widths);
+	
+	// operands come before the expressions that use them, so one pass in order sees them simplified already
+	for(uint32_t node = 0; node < ast->node_count; node++) {
+		while(current_function(&o) && node >= current_function(&o)->end) o.functions.size -= sizeof(uint32_t);
+		switch(ast->types[node]) {
+		case FUNCTION_DECLARATION:
+			buffer_append(&o.functions, (const char*)&node, sizeof(node));
+			break;
+		case BINARY_EXPRESSION: {
+			int constant_left = ast->types[ast->lhs[node]] == NUMERIC_LITERAL;
+			int constant_right = ast->types[ast->rhs[node]] == NUMERIC_LITERAL;
+			if(constant_left && constant_right) fold_constants(&o, node);
+			else if(constant_left || constant_right) simplify(&o, node);
+			break;
+		}
+		default:
+			break;
+		}
+		o.widths[node] = expression_width(&o, node);
+	}
+	
+	int failed = o.failed;
+	pop_cleanup(1); // widths
+	pop_cleanup(1);
+	if(failed) fail();
+	
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "parser.h"
+
+// Simplifies expressions in place, after resolve(). Constant subexpressions are folded with the semantics of the
+// generated C code, x + 0, x - 0, x * 1, x / 1 and x * 0 lose their constant, and multiplication, division and modulo
+// by powers of two become shifts and masks where the value and type stay the same. No nodes are added, the ones that
+// get replaced are left behind unreferenced. Division by zero is an error, signed overflow a warning (it wraps around).
+void optimize(struct ast* ast);
@@ -2,290 +2,493 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include "buffer.h"
+#include "error.h"
 
-struct token* consume_token(struct token** tokens) {
+struct parser {
+	struct token* tokens;
+	const char* source;
+	struct ast* ast;
+	struct buffer operands; // nodes, the stacks of parse_expression()
+	struct buffer operators; // token pointers, binary operators and opening parentheses
+	struct buffer statements; // nodes of all blocks that are still open, innermost last
+};
+
+void* grow_array(void* data, uint32_t capacity, size_t element_size) {
+	
+	data = realloc(data, capacity * element_size);
+	if(!data) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	return data;
+	
+}
+
+uint32_t grow_capacity(uint32_t capacity, uint32_t needed) {
+	
+	if(needed > UINT32_MAX - 1) { // NO_NODE has to stay free
+		fprintf(stderr, "E: The program is too big!\n");
+		fail();
+	}
+	if(!capacity) capacity = 1024;
+	while(capacity < needed) capacity = capacity > UINT32_MAX / 2 ? UINT32_MAX - 1 : capacity * 2;
+	return capacity;
+	
+}
+
+uint32_t add_node(struct ast* ast, enum ast_node_type type, uint32_t lhs, uint32_t rhs) {
+	
+	if(ast->node_count == ast->node_capacity) {
+		ast->node_capacity = grow_capacity(ast->node_capacity, ast->node_count + 1);
+		ast->types = grow_array(ast->types, ast->node_capacity, sizeof(uint8_t));
+		ast->operators = grow_array(ast->operators, ast->node_capacity, sizeof(uint8_t));
+		ast->lhs = grow_array(ast->lhs, ast->node_capacity, sizeof(uint32_t));
+		ast->rhs = grow_array(ast->rhs, ast->node_capacity, sizeof(uint32_t));
+	}
+	
+	uint32_t node = ast->node_count++;
+	ast->types[node] = type;
+	ast->operators[node] = 0;
+	ast->lhs[node] = lhs;
+	ast->rhs[node] = rhs;
+	return node;
+	
+}
+
+uint64_t literal_value(struct ast* ast, uint32_t node) {
+	
+	return (uint64_t)ast->rhs[node] << 32 | ast->lhs[node];
+	
+}
+
+uint32_t hash_string(const char* str, size_t length) { // FNV-1a
+	
+	uint32_t hash = 0x811c9dc5;
+	for(size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)str[i]) * 0x01000193;
+	return hash;
+	
+}
+
+void grow_string_table(struct ast* ast) {
+	
+	uint32_t size = ast->string_table_size ? ast->string_table_size * 2 : 1024;
+	if(!size) grow_capacity(0, UINT32_MAX); // more strings than a 32-bit table can index
+	struct string_slot* table = calloc(size, sizeof(struct string_slot));
+	if(!table) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	
+	for(uint32_t i = 0; i < ast->string_table_size; i++) {
+		if(!ast->string_table[i].offset) continue;
+		uint32_t slot = ast->string_table[i].hash & (size - 1);
+		while(table[slot].offset) slot = (slot + 1) & (size - 1);
+		table[slot] = ast->string_table[i];
+	}
+	
+	free(ast->string_table);
+	ast->string_table = table;
+	ast->string_table_size = size;
+	
+}
+
+uint32_t intern_string(struct ast* ast, const char* str, size_t length) {
+	
+	if(ast->string_count >= ast->string_table_size / 2) grow_string_table(ast);
+	
+	// the hashes are compared first, most lookups only touch the strings for the one that matches
+	uint32_t hash = hash_string(str, length);
+	uint32_t mask = ast->string_table_size - 1;
+	uint32_t slot = hash & mask;
+	for(; ast->string_table[slot].offset; slot = (slot + 1) & mask) {
+		if(ast->string_table[slot].hash != hash) continue;
+		const char* candidate = ast->strings + ast->string_table[slot].offset - 1;
+		if(!strncmp(candidate, str, length) && !candidate[length]) return ast->string_table[slot].offset - 1;
+	}
+	
+	if(length >= UINT32_MAX - ast->string_size) grow_capacity(0, UINT32_MAX);
+	if(ast->string_capacity - ast->string_size <= length) {
+		ast->string_capacity = grow_capacity(ast->string_capacity, ast->string_size + length + 1);
+		ast->strings = grow_array(ast->strings, ast->string_capacity, sizeof(char));
+	}
+	
+	uint32_t offset = ast->string_size;
+	memcpy(ast->strings + offset, str, length);
+	ast->strings[offset + length] = 0;
+	ast->string_size += length + 1;
+	ast->string_table[slot].offset = offset + 1;
+	ast->string_table[slot].hash = hash;
+	ast->string_count++;
+	return offset;
+	
+}
+
+uint32_t add_function(struct ast* ast, struct function* function) { // returns the index in functions
+	
+	if(ast->function_count == ast->function_capacity) {
+		ast->function_capacity = grow_capacity(ast->function_capacity, ast->function_count + 1);
+		ast->functions = grow_array(ast->functions, ast->function_capacity, sizeof(struct function));
+	}
+	ast->functions[ast->function_count] = *function;
+	return ast->function_count++;
+	
+}
+
+uint32_t add_list(struct ast* ast, const uint32_t* nodes, uint32_t count) { // returns the offset
+	
+	if(count >= UINT32_MAX - ast->list_size) grow_capacity(0, UINT32_MAX);
+	if(ast->list_capacity - ast->list_size <= count) {
+		ast->list_capacity = grow_capacity(ast->list_capacity, ast->list_size + count + 1);
+		ast->lists = grow_array(ast->lists, ast->list_capacity, sizeof(uint32_t));
+	}
 	
-	struct token* tok = *tokens;
-	*tokens = (struct token*)((size_t)(*tokens) + (*tokens)->size + sizeof(struct token));
-	return tok;
+	uint32_t offset = ast->list_size;
+	ast->lists[offset] = count;
+	memcpy(ast->lists + offset + 1, nodes, count * sizeof(uint32_t));
+	ast->list_size += count + 1;
+	return offset;
 	
 }
 
-struct statement* parse_expression(struct token** tokens);
+struct token* consume_token(struct parser* parser) {
+	
+	return parser->tokens++;
+	
+}
+
+int match_punctuator(struct token* token, enum punctuator punctuator) {
+	
+	return token->type == TOKEN_PUNCTUATOR && token->kind == punctuator;
+	
+}
+
+int match_operator(struct token* token, enum operator operator) {
+	
+	return token->type == TOKEN_OPERATOR && token->kind == operator;
+	
+}
 
-struct statement* parse_primary_expression(struct token** tokens) {
+uint32_t parse_primary_expression(struct parser* parser) { // literals and identifiers, parentheses are handled by parse_expression()
 	
-	switch((*tokens)->type) {
+	switch(parser->tokens->type) {
 	case TOKEN_INTEGER_LITERAL: {
-		struct token* token = consume_token(tokens);
-		struct numeric_literal* stmt = malloc(sizeof(struct numeric_literal));
-		if(!stmt) {
-			fprintf(stderr, "E: Failed to allocate memory!\n");
-			exit(1);
-		}
-		stmt->stmt.type = NUMERIC_LITERAL;
-		stmt->num = *(int*)token->data;
-		return (struct statement*)stmt;
+		struct token* token = consume_token(parser);
+		uint32_t node = add_node(parser->ast, NUMERIC_LITERAL, (uint32_t)token->value, token->value >> 32);
+		parser->ast->operators[node] = token->kind;
+		return node;
 	}
 	case TOKEN_IDENTIFIER: {
-		struct token* token = consume_token(tokens);
-		struct identifier* stmt = malloc(sizeof(struct identifier) + strlen(token->data) + 1);
-		if(!stmt) {
-			fprintf(stderr, "E: Failed to allocate memory!\n");
-			exit(1);
-		}
-		stmt->stmt.type = IDENTIFIER;
-		memcpy(stmt->symbol, token->data, strlen(token->data) + 1);
-		return (struct statement*)stmt;
+		struct token* token = consume_token(parser);
+		return add_node(parser->ast, IDENTIFIER, intern_string(parser->ast, &parser->source[token->offset], token->length), token->line);
 	}
-	case TOKEN_PUNCTUATOR:
-		if((*tokens)->data[0] != '(') return 0;
-		consume_token(tokens);
-		struct statement* stmt = parse_expression(tokens);
-		struct token* tok = consume_token(tokens);
-		if(tok->type != TOKEN_PUNCTUATOR || tok->data[0] != ')') {
-			fprintf(stderr, "Unclosed parenthesis in line %d!\n", tok->line);
-			exit(1);
-		}
-		return stmt;
+	default:
+		return NO_NODE;
+	}
+	
+}
+
+int binary_precedence(struct token* token) { // 0 for anything that isn't a binary operator, including parentheses
+	
+	if(token->type != TOKEN_OPERATOR) return 0;
+	switch(token->kind) {
+	case OPERATOR_ASTERISK:
+	case OPERATOR_SLASH:
+	case OPERATOR_PERCENT:
+		return 2;
+	case OPERATOR_PLUS:
+	case OPERATOR_MINUS:
+		return 1;
 	default:
 		return 0;
 	}
 	
 }
 
-struct statement* parse_multiplicative_expression(struct token** tokens) {
+void push_node(struct buffer* stack, uint32_t node) {
 	
-	struct statement* left = parse_primary_expression(tokens);
-	if(!left) return 0;
+	buffer_append(stack, (const char*)&node, sizeof(node));
 	
-	while((*tokens)->type == TOKEN_OPERATOR && (!strcmp((*tokens)->data, "*") || !strcmp((*tokens)->data, "/") || !strcmp((*tokens)->data, "%"))) {
-		
-		struct token* tok = consume_token(tokens);
-		struct statement* right = parse_primary_expression(tokens);
-		if(!right) {
-			fprintf(stderr, "E: Invalid expression in line %d!\n", tok->line);
-			exit(1);
-		}
-		struct binary_expression* operation = malloc(sizeof(struct binary_expression));
-		if(!operation) {
-			fprintf(stderr, "E: Failed to allocate memory!\n");
-			exit(1);
-		}
-		operation->stmt.type = BINARY_EXPRESSION;
-		operation->left = left;
-		operation->right = right;
-		if(!strcmp(tok->data, "*")) operation->operator = OP_MULTIPLY;
-		else if(!strcmp(tok->data, "/")) operation->operator = OP_DIVIDE;
-		else operation->operator = OP_MODULO;
-		left = (struct statement*)operation;
-		
-	}
+}
+
+uint32_t pop_node(struct buffer* stack) {
+	
+	stack->size -= sizeof(uint32_t);
+	uint32_t node;
+	memcpy(&node, stack->data + stack->size, sizeof(node));
+	return node;
+	
+}
+
+void push_operator(struct buffer* stack, struct token* token) {
+	
+	buffer_append(stack, (const char*)&token, sizeof(token));
 	
-	return left;
+}
+
+struct token* pop_operator(struct buffer* stack) {
+	
+	stack->size -= sizeof(struct token*);
+	struct token* token;
+	memcpy(&token, stack->data + stack->size, sizeof(token));
+	return token;
+	
+}
+
+struct token* top_operator(struct buffer* stack) { // NULL if the stack is empty
+	
+	if(!stack->size) return 0;
+	struct token* token;
+	memcpy(&token, stack->data + stack->size - sizeof(token), sizeof(token));
+	return token;
+	
+}
+
+void reduce_expression(struct parser* parser) { // replaces the two topmost operands with the topmost operator applied to them
+	
+	struct token* tok = pop_operator(&parser->operators);
+	uint32_t right = pop_node(&parser->operands);
+	uint32_t left = pop_node(&parser->operands);
+	uint32_t operation = add_node(parser->ast, BINARY_EXPRESSION, left, right);
+	switch(tok->kind) {
+	case OPERATOR_PLUS: parser->ast->operators[operation] = OP_ADD; break;
+	case OPERATOR_MINUS: parser->ast->operators[operation] = OP_SUBTRACT; break;
+	case OPERATOR_ASTERISK: parser->ast->operators[operation] = OP_MULTIPLY; break;
+	case OPERATOR_SLASH: parser->ast->operators[operation] = OP_DIVIDE; break;
+	default: parser->ast->operators[operation] = OP_MODULO; break;
+	}
+	push_node(&parser->operands, operation);
 	
 }
 
-struct statement* parse_additive_expression(struct token** tokens) {
+// Operator precedence parsing with explicit stacks instead of recursion, so neither long chains nor deeply
+// nested parentheses use more native stack. Operators of the same precedence associate to the left.
+uint32_t parse_expression(struct parser* parser) {
 	
-	struct statement* left = parse_multiplicative_expression(tokens);
-	if(!left) return 0;
+	parser->operands.size = 0;
+	parser->operators.size = 0;
+	size_t open_parens = 0;
 	
-	while((*tokens)->type == TOKEN_OPERATOR && (!strcmp((*tokens)->data, "+") || !strcmp((*tokens)->data, "-"))) {
+	for(;;) {
+		
+		while(match_punctuator(parser->tokens, PUNCTUATOR_OPEN_PAREN)) {
+			push_operator(&parser->operators, consume_token(parser));
+			open_parens++;
+		}
 		
-		struct token* tok = consume_token(tokens);
-		struct statement* right = parse_multiplicative_expression(tokens);
-		if(!right) {
+		uint32_t operand = parse_primary_expression(parser);
+		if(operand == NO_NODE) {
+			struct token* tok = top_operator(&parser->operators);
+			if(!tok) return NO_NODE; // not an expression at all
 			fprintf(stderr, "E: Invalid expression in line %d!\n", tok->line);
-			exit(1);
+			fail();
 		}
-		struct binary_expression* operation = malloc(sizeof(struct binary_expression));
-		if(!operation) {
-			fprintf(stderr, "E: Failed to allocate memory!\n");
-			exit(1);
+		push_node(&parser->operands, operand);
+		
+		while(open_parens && match_punctuator(parser->tokens, PUNCTUATOR_CLOSE_PAREN)) {
+			consume_token(parser);
+			while(!match_punctuator(top_operator(&parser->operators), PUNCTUATOR_OPEN_PAREN)) reduce_expression(parser);
+			pop_operator(&parser->operators);
+			open_parens--;
 		}
-		operation->stmt.type = BINARY_EXPRESSION;
-		operation->left = left;
-		operation->right = right;
-		if(!strcmp(tok->data, "+")) operation->operator = OP_ADD;
-		else operation->operator = OP_SUBTRACT;
-		left = (struct statement*)operation;
+		
+		int precedence = binary_precedence(parser->tokens);
+		if(!precedence) break;
+		while(parser->operators.size && binary_precedence(top_operator(&parser->operators)) >= precedence) reduce_expression(parser);
+		push_operator(&parser->operators, consume_token(parser));
 		
 	}
 	
-	return left;
-	
-}
-
-struct statement* parse_expression(struct token** tokens) {
+	if(open_parens) {
+		struct token* tok = consume_token(parser);
+		fprintf(stderr, "E: Unclosed parenthesis in line %d!\n", tok->line);
+		fail();
+	}
+	while(parser->operators.size) reduce_expression(parser);
 	
-	return parse_additive_expression(tokens);
+	return pop_node(&parser->operands);
 	
 }
 
-struct statement* parse_statement(struct token** tokens, const char* func_prefix);
+uint32_t parse_statement(struct parser* parser);
 
-struct statement_list* parse_block(struct token** tokens, const char* func_prefix) {
-	
-	struct statement_list* list;
-	struct statement_list** next = &list;
+uint32_t parse_block(struct parser* parser) { // returns the offset of the list
 	
-	struct token* open_brace = consume_token(tokens);
-	if(open_brace->type != TOKEN_PUNCTUATOR || open_brace->data[0] != '{') {
+	struct token* open_brace = consume_token(parser);
+	if(!match_punctuator(open_brace, PUNCTUATOR_OPEN_BRACE)) {
 		fprintf(stderr, "E: Opening brace expected in line %d!\n", open_brace->line);
-		exit(1);
+		fail();
 	}
 	
-	while((*tokens)->type != TOKEN_PUNCTUATOR && (*tokens)->data[0] != '}') {
+	// the statements wait on a stack shared by all nested blocks until the block is complete,
+	// the inner blocks have taken theirs off again by then
+	size_t base = parser->statements.size;
+	while(!match_punctuator(parser->tokens, PUNCTUATOR_CLOSE_BRACE)) {
 		
-		struct statement* stmt = parse_statement(tokens, func_prefix);
-		*next = malloc(sizeof(struct statement_list));
-		if(!*next) {
-			fprintf(stderr, "E: Failed to allocate memory!\n");
-			exit(1);
+		if(parser->tokens->type == TOKEN_END) {
+			fprintf(stderr, "E: Closing brace expected in line %d!\n", parser->tokens->line);
+			fail();
 		}
-		(*next)->statement = stmt;
-		(*next)->next = 0;
-		next = &(*next)->next;
+		
+		push_node(&parser->statements, parse_statement(parser));
 		
 	}
-	consume_token(tokens); // consume closing brace
-	
-	*next = malloc(sizeof(struct statement_list));
-	if(!*next) {
-		fprintf(stderr, "E: Failed to allocate memory!\n");
-		exit(1);
-	}
-	(*next)->next = 0;
+	consume_token(parser); // consume closing brace
 	
+	uint32_t count = (parser->statements.size - base) / sizeof(uint32_t);
+	uint32_t list = add_list(parser->ast, (const uint32_t*)(parser->statements.data + base), count);
+	parser->statements.size = base;
 	return list;
 	
 }
 
-struct statement* parse_function_declaration(struct token** tokens, const char* prefix) {
+uint32_t parse_function_declaration(struct parser* parser) {
 	
-	consume_token(tokens); // FN keyword
-	if((*tokens)->type != TOKEN_IDENTIFIER) {
-		fprintf(stderr, "E: Expected identifier (function name) in line %d!\n", (*tokens)->line);
-		exit(1);
+	consume_token(parser); // FN keyword
+	if(parser->tokens->type != TOKEN_IDENTIFIER) {
+		fprintf(stderr, "E: Expected identifier (function name) in line %d!\n", parser->tokens->line);
+		fail();
 	}
 	
-	struct token* name = consume_token(tokens); // function name
+	struct token* name = consume_token(parser); // function name
 	
-	struct token* open_paren = consume_token(tokens);
-	if(open_paren->type != TOKEN_PUNCTUATOR || open_paren->data[0] != '(') {
-		fprintf(stderr, "E: Expected opening parenthesis after function name in line %d!\n", (*tokens)->line);
-		exit(1);
+	struct token* open_paren = consume_token(parser);
+	if(!match_punctuator(open_paren, PUNCTUATOR_OPEN_PAREN)) {
+		fprintf(stderr, "E: Expected opening parenthesis after function name in line %d!\n", open_paren->line);
+		fail();
 	}
 	
 	/// TODO: function arguments
 	
-	struct token* close_paren = consume_token(tokens);
-	if(close_paren->type != TOKEN_PUNCTUATOR || close_paren->data[0] != ')') {
-		fprintf(stderr, "E: Expected closing parenthesis after function name in line %d!\n", (*tokens)->line);
-		exit(1);
+	struct token* close_paren = consume_token(parser);
+	if(!match_punctuator(close_paren, PUNCTUATOR_CLOSE_PAREN)) {
+		fprintf(stderr, "E: Expected closing parenthesis after function name in line %d!\n", close_paren->line);
+		fail();
 	}
 	
-	struct token* token = consume_token(tokens);
-	const char* return_type = "void";
+	struct token* type = 0;
 	
-	if(token->type == TOKEN_OPERATOR && !strcmp(token->data, "->")) {
+	if(match_operator(parser->tokens, OPERATOR_ARROW)) {
 		
-		struct token* type = consume_token(tokens);
+		consume_token(parser);
+		type = consume_token(parser);
 		if(type->type != TOKEN_IDENTIFIER) {
 			fprintf(stderr, "E: Expected return type in line %d!\n", type->line);
-			exit(1);
+			fail();
 		}
-		return_type = type->data;
 		
 	}
 	
-	int prefixed = 0;
-	if(strlen(prefix)) prefixed = 1;
+	struct ast* ast = parser->ast;
+	struct function function = {0};
+	function.name = function.symbol = intern_string(ast, &parser->source[name->offset], name->length);
+	if(type) function.return_type = intern_string(ast, &parser->source[type->offset], type->length);
+	else function.return_type = intern_string(ast, "void", strlen("void"));
+	function.line = name->line;
 	
-	struct function_declaration* stmt = malloc(sizeof(struct function_declaration) + strlen(name->data) + strlen(prefix) + 1 + prefixed);
-	if(!stmt) {
-		fprintf(stderr, "E: Failed to allocate memory!\n");
-		exit(1);
-	}
+	// the declaration comes before its body, the body's list is only known at the end
+	uint32_t index = add_function(ast, &function);
+	uint32_t stmt = add_node(ast, FUNCTION_DECLARATION, index, 0);
+	uint32_t body = parse_block(parser);
+	ast->functions[index].body = body;
+	ast->functions[index].end = ast->node_count;
 	
-	stmt->stmt.type = FUNCTION_DECLARATION;
-	memcpy(stmt->name, prefix, strlen(prefix));
-	if(prefixed) stmt->name[strlen(prefix)] = '_';
-	memcpy(stmt->name + strlen(prefix) + prefixed, name->data, strlen(name->data) + 1);
-	stmt->body = parse_block(tokens, stmt->name);
-	stmt->return_type = return_type;
-	
-	return (struct statement*)stmt;
+	return stmt;
 	
 }
 
-struct statement* parse_return(struct token** tokens) {
+uint32_t parse_return(struct parser* parser) {
 	
-	consume_token(tokens);
-	struct return_statement* stmt = malloc(sizeof(struct return_statement));
-	stmt->stmt.type = RETURN_STATEMENT;
-	stmt->value = parse_expression(tokens);
+	consume_token(parser);
+	uint32_t stmt = add_node(parser->ast, RETURN_STATEMENT, NO_NODE, 0);
+	uint32_t value = parse_expression(parser);
+	parser->ast->lhs[stmt] = value;
 	
-	struct token* tok = consume_token(tokens);
-	if(tok->type != TOKEN_PUNCTUATOR || tok->data[0] != ';') {
+	struct token* tok = consume_token(parser);
+	if(!match_punctuator(tok, PUNCTUATOR_SEMICOLON)) {
 		fprintf(stderr, "E: Unexpected token in line %d!\n", tok->line);
-		exit(1);
+		fail();
 	}
 	
-	return (struct statement*)stmt;
+	return stmt;
 	
 }
 
-struct statement* parse_statement(struct token** tokens, const char* func_prefix) {
+uint32_t parse_statement(struct parser* parser) {
 	
-	if((*tokens)->type == TOKEN_KEYWORD && *(enum keyword*)((*tokens)->data) == KEYWORD_FN) return parse_function_declaration(tokens, func_prefix);
-	if((*tokens)->type == TOKEN_KEYWORD && *(enum keyword*)((*tokens)->data) == KEYWORD_RETURN) return parse_return(tokens);
+	if(parser->tokens->type == TOKEN_KEYWORD && parser->tokens->kind == KEYWORD_FN) return parse_function_declaration(parser);
+	if(parser->tokens->type == TOKEN_KEYWORD && parser->tokens->kind == KEYWORD_RETURN) return parse_return(parser);
 	
-	struct statement* ret = parse_expression(tokens);
+	uint32_t ret = parse_expression(parser);
 	
-	struct token* tok = consume_token(tokens);
-	if(tok->type != TOKEN_PUNCTUATOR || tok->data[0] != ';') {
+	struct token* tok = consume_token(parser);
+	if(ret == NO_NODE || !match_punctuator(tok, PUNCTUATOR_SEMICOLON)) {
 		fprintf(stderr, "E: Unexpected token in line %d!\n", tok->line);
-		exit(1);
+		fail();
 	}
 	
 	return ret;
 	
 }
 
-struct ast* parse(struct token* tokens) {
+void free_parser(void* arg) {
+	
+	struct parser* parser = arg;
+	buffer_free(&parser->operands);
+	buffer_free(&parser->operators);
+	buffer_free(&parser->statements);
+	
+}
+
+struct ast* parse(struct token* tokens, const char* source) {
 	
-	struct ast* ast = malloc(sizeof(struct ast));
+	struct ast* ast = calloc(1, sizeof(struct ast));
 	if(!ast) {
 		fprintf(stderr, "E: Failed to allocate memory!\n");
-		exit(1);
+		fail();
 	}
+	push_cleanup(ast_cleanup, ast);
 	
-	ast->stmt.type = AST;
-	struct statement_list** next = &ast->body;
+	struct parser parser = {tokens, source, ast};
+	push_cleanup(free_parser, &parser);
 	
-	while(tokens->type != TOKEN_END) {
-		
-		struct statement* stmt = parse_statement(&tokens, "");
-		*next = malloc(sizeof(struct statement_list));
-		if(!*next) {
-			fprintf(stderr, "E: Failed to allocate memory!\n");
-			exit(1);
-		}
-		(*next)->statement = stmt;
-		(*next)->next = 0;
-		next = &(*next)->next;
+	while(parser.tokens->type != TOKEN_END) push_node(&parser.statements, parse_statement(&parser));
+	ast->body = add_list(ast, (const uint32_t*)parser.statements.data, parser.statements.size / sizeof(uint32_t));
+	
+	pop_cleanup(1); // parser
+	pop_cleanup(0); // ast
+	return ast;
+	
+}
+
+size_t ast_memory(struct ast* ast) {
+	
+	return (size_t)ast->node_count * (2 * sizeof(uint8_t) + 2 * sizeof(uint32_t)) + (size_t)ast->list_size * sizeof(uint32_t)
+		+ (size_t)ast->function_count * sizeof(struct function) + ast->string_size + (size_t)ast->string_table_size * sizeof(struct string_slot);
 		
-	}
+}
+
+void free_ast(struct ast* ast) {
 	
-	*next = malloc(sizeof(struct statement_list));
-	if(!*next) {
-		fprintf(stderr, "E: Failed to allocate memory!\n");
-		exit(1);
+	if(!ast) return;
+	if(ast->mapped) {
+		free(ast);
+		return;
 	}
-	(*next)->next = 0;
+	free(ast->types);
+	free(ast->operators);
+	free(ast->lhs);
+	free(ast->rhs);
+	free(ast->lists);
+	free(ast->functions);
+	free(ast->strings);
+	free(ast->string_table);
+	free(ast);
 	
-	return ast;
+}
+
+void ast_cleanup(void* ast) {
+	
+	free_ast(ast);
 	
 }
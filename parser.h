@@ -1,8 +1,10 @@
 #pragma once
+#include <stdint.h>
 #include "lexer.h"
 
+#define NO_NODE UINT32_MAX
+
 enum ast_node_type {
-	AST,
 	NUMERIC_LITERAL,
 	IDENTIFIER,
 	BINARY_EXPRESSION,
@@ -10,55 +12,67 @@ enum ast_node_type {
 	RETURN_STATEMENT
 };
 
-struct statement {
-	enum ast_node_type type;
-};
-
-struct statement_list {
-	struct statement_list* next;
-	struct statement* statement;
-};
-
-struct ast {
-	struct statement stmt;
-	struct statement_list* body;
-};
-
-struct identifier {
-	struct statement stmt;
-	char symbol[0];
-};
-
-struct numeric_literal {
-	struct statement stmt;
-	int num;
-};
-
 enum binary_operation {
 	OP_ADD,
 	OP_SUBTRACT,
 	OP_MULTIPLY,
 	OP_DIVIDE,
-	OP_MODULO
+	OP_MODULO,
+	OP_SHIFT_LEFT, // only made by optimize(), like the two below
+	OP_SHIFT_RIGHT, // of the left operand converted to u64
+	OP_AND
 };
 
-struct binary_expression {
-	struct statement stmt;
-	struct statement* left;
-	struct statement* right;
-	enum binary_operation operator;
+struct function { // everything about a function declaration that doesn't fit into its node
+	uint32_t name; // as written, in strings
+	uint32_t symbol; // the name in the generated code, only differs from name for nested functions once resolve() has run
+	uint32_t return_type; // in strings
+	uint32_t body; // offset in lists
+	uint32_t end; // the node after the last one of the body, the body's nodes come right after the declaration
+	int line;
 };
 
-struct function_declaration {
-	struct statement stmt;
-	struct statement_list* body;
-	const char* return_type;
-	char name[0];
+struct string_slot {
+	uint32_t offset; // in strings plus one, 0 for an empty slot
+	uint32_t hash;
 };
 
-struct return_statement {
-	struct statement stmt;
-	struct statement* value;
+// The AST is flat: a node is a 32-bit index into parallel arrays, what lhs and rhs hold depends on its type:
+//	NUMERIC_LITERAL - lhs and rhs: the low and high 32 bits of the value, sign-extended for signed widths; operators: its width
+//	IDENTIFIER - lhs: offset of the symbol in strings; rhs: the line
+//	BINARY_EXPRESSION - lhs and rhs: the operands, operators: the operation
+//	FUNCTION_DECLARATION - lhs: index into functions
+//	RETURN_STATEMENT - lhs: the value or NO_NODE
+// A list is the number of statements followed by their nodes. Every node comes after all nodes it refers to,
+// except for function declarations, which come before their bodies.
+struct ast {
+	uint8_t* types; // enum ast_node_type
+	uint8_t* operators; // enum binary_operation for binary expressions, enum literal_width for numeric literals
+	uint32_t* lhs;
+	uint32_t* rhs;
+	uint32_t node_count;
+	uint32_t node_capacity;
+	uint32_t* lists;
+	uint32_t list_size;
+	uint32_t list_capacity;
+	struct function* functions;
+	uint32_t function_count;
+	uint32_t function_capacity;
+	char* strings; // NUL-terminated, every string is only stored once
+	uint32_t string_size;
+	uint32_t string_capacity;
+	struct string_slot* string_table; // open addressing hash table of strings
+	uint32_t string_table_size; // a power of two, at most half full
+	uint32_t string_count;
+	uint32_t body; // offset of the top-level statements in lists
+	int mapped; // the arrays point into a loaded module (see module.h), they can't grow and aren't freed with the AST
 };
 
-struct ast* parse(struct token* tokens);
+struct ast* parse(struct token* tokens, const char* source);
+uint32_t intern_string(struct ast* ast, const char* str, size_t length); // returns the offset of the only copy in strings
+uint64_t literal_value(struct ast* ast, uint32_t node);
+void* grow_array(void* data, uint32_t capacity, size_t element_size);
+uint32_t grow_capacity(uint32_t capacity, uint32_t needed); // fails if needed doesn't fit into 32 bits
+size_t ast_memory(struct ast* ast); // bytes used by the arrays, not counting unused capacity
+void free_ast(struct ast* ast);
+void ast_cleanup(void* ast); // free_ast() for push_cleanup()
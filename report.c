@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "report.h"
+
+struct phase_start {
+	double wall;
+	double cpu;
+	long heap;
+};
+
+const char* phase_names[PHASE_COUNT] = {"read", "cache", "tokenize", "parse", "resolve", "optimize", "generate", "compile", "run", "cleanup"};
+
+struct time_report report;
+int report_resident;
+struct phase_start phase_starts[PHASE_COUNT];
+int peak_reset; // the high-water mark of the RSS was reset for the current compilation
+
+double timeval_seconds(struct timeval tv) {
+	
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+	
+}
+
+struct phase_start current_counters() {
+	
+	struct phase_start now;
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now.wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+	
+	struct rusage self, children;
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children); // gcc
+	now.cpu = timeval_seconds(self.ru_utime) + timeval_seconds(self.ru_stime) + timeval_seconds(children.ru_utime) + timeval_seconds(children.ru_stime);
+	
+	struct mallinfo2 info = mallinfo2();
+	now.heap = info.uordblks + info.hblkhd; // small allocations plus the ones that got their own mapping
+	
+	return now;
+	
+}
+
+// ru_maxrss never goes down, a resident process resets the kernel's high-water mark instead and reads that one.
+int reset_peak_rss() {
+	
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if(!file) return 0;
+	int ok = fputs("5", file) >= 0;
+	return !fclose(file) && ok;
+	
+}
+
+long read_peak_rss() { // KiB, -1 if it can't be read
+	
+	FILE* file = fopen("/proc/self/status", "r");
+	if(!file) return -1;
+	long peak = -1;
+	char line[256];
+	while(fgets(line, sizeof(line), file)) {
+		if(!strncmp(line, "VmHWM:", 6)) sscanf(line + 6, "%ld", &peak);
+	}
+	fclose(file);
+	return peak;
+	
+}
+
+void report_reset(int enabled) {
+	
+	report = (struct time_report){0};
+	report.enabled = enabled;
+	peak_reset = enabled && report_resident && reset_peak_rss();
+	
+}
+
+void report_begin(enum phase phase) {
+	
+	if(!report.enabled) return;
+	phase_starts[phase] = current_counters();
+	
+}
+
+void report_end(enum phase phase) {
+	
+	if(!report.enabled) return;
+	struct phase_start now = current_counters();
+	report.phases[phase].wall += now.wall - phase_starts[phase].wall;
+	report.phases[phase].cpu += now.cpu - phase_starts[phase].cpu;
+	report.phases[phase].allocated += now.heap - phase_starts[phase].heap;
+	
+}
+
+void print_report(enum report_format format) {
+	
+	if(format == REPORT_NONE) return;
+	
+	long peak_rss = -1; // KiB, unknown in a server that couldn't reset it
+	if(peak_reset) peak_rss = read_peak_rss();
+	else if(!report_resident) {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		peak_rss = usage.ru_maxrss;
+	}
+	
+	struct phase_times total = {0};
+	for(int i = 0; i < PHASE_COUNT; i++) {
+		total.wall += report.phases[i].wall;
+		total.cpu += report.phases[i].cpu;
+	}
+	
+	if(format == REPORT_JSON) {
+		fprintf(stderr, "{\"phases\":{");
+		for(int i = 0; i < PHASE_COUNT; i++) {
+			fprintf(stderr, "%s\"%s\":{\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f,\"allocated_bytes\":%ld}", i ? "," : "", phase_names[i], report.phases[i].wall, report.phases[i].cpu, report.phases[i].allocated);
+		}
+		fprintf(stderr, "},\"total_wall_seconds\":%.6f,\"total_cpu_seconds\":%.6f,\"tokens\":%zu,\"ast_nodes\":%zu,\"peak_rss_kib\":", total.wall, total.cpu, report.tokens, report.nodes);
+		if(peak_rss < 0) fprintf(stderr, "null}\n");
+		else fprintf(stderr, "%ld}\n", peak_rss);
+		return;
+	}
+	
+	fprintf(stderr, "%-10s %12s %12s %16s\n", "phase", "wall ms", "cpu ms", "allocated bytes");
+	for(int i = 0; i < PHASE_COUNT; i++) {
+		fprintf(stderr, "%-10s %12.3f %12.3f %16ld\n", phase_names[i], report.phases[i].wall * 1e3, report.phases[i].cpu * 1e3, report.phases[i].allocated);
+	}
+	fprintf(stderr, "%-10s %12.3f %12.3f\n", "total", total.wall * 1e3, total.cpu * 1e3);
+	fprintf(stderr, "tokens: %zu, AST nodes: %zu, ", report.tokens, report.nodes);
+	if(peak_rss < 0) fprintf(stderr, "peak RSS: unknown\n");
+	else fprintf(stderr, "peak RSS: %ld KiB\n", peak_rss);
+	
+}
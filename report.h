@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+
+enum phase {
+	PHASE_READ, // reading the input files
+	PHASE_CACHE, // computing the cache key, looking it up and storing the result
+	PHASE_TOKENIZE,
+	PHASE_PARSE, // including merging the files
+	PHASE_RESOLVE,
+	PHASE_OPTIMIZE,
+	PHASE_GENERATE, // C code, machine code or bytecode
+	PHASE_COMPILE, // running gcc
+	PHASE_RUN, // running the program with --run, or the training command of --pgo-train
+	PHASE_CLEANUP,
+	PHASE_COUNT
+};
+
+enum report_format {
+	REPORT_NONE,
+	REPORT_TEXT,
+	REPORT_JSON
+};
+
+struct phase_times {
+	double wall; // seconds
+	double cpu; // seconds, all threads and waited-for child processes together
+	long allocated; // growth of the heap, negative if the phase released more than it allocated
+};
+
+struct time_report {
+	int enabled; // report_begin() and report_end() do nothing otherwise
+	struct phase_times phases[PHASE_COUNT];
+	size_t tokens;
+	size_t nodes;
+};
+
+extern struct time_report report; // filled in by compile(), phases may be entered more than once and add up
+extern int report_resident; // set by a server, whose own peak RSS isn't the one of the current compilation
+
+void report_reset(int enabled);
+void report_begin(enum phase phase);
+void report_end(enum phase phase);
+void print_report(enum report_format format); // to stderr, together with the peak RSS of the compilation if it's known
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resolve.h"
+#include "buffer.h"
+#include "error.h"
+
+#define EMPTY_ENTRY UINT32_MAX
+#define TYPE_ENTRY NO_NODE
+
+const char* builtin_types[] = {"void", "u8", "i8", "u16", "i16", "u32", "i32", "u64", "i64"}; // the typedefs of generate_c_prelude()
+
+struct scope_entry {
+	uint32_t name; // interned, comparing offsets is comparing names
+	uint32_t node; // the function declaration, or TYPE_ENTRY
+};
+
+struct scope { // an open addressing table in the resolver's entries
+	size_t first; // index of the first entry
+	uint32_t size; // a power of two, at most half full
+};
+
+struct resolver {
+	struct ast* ast;
+	struct buffer entries; // the tables of all open scopes, innermost last
+	struct buffer scopes;
+	uint32_t* symbols; // open addressing table of function declarations plus one, by symbol
+	uint32_t symbol_table_size;
+	struct buffer name; // for putting symbols together
+	int failed;
+};
+
+uint32_t hash_offset(uint32_t offset) {
+	
+	offset ^= offset >> 16;
+	offset *= 0x85ebca6b;
+	offset ^= offset >> 13;
+	return offset;
+	
+}
+
+void push_scope(struct resolver* r, uint32_t count) {
+	
+	struct scope scope = {r->entries.size / sizeof(struct scope_entry), 8};
+	while(scope.size < count * 2) scope.size *= 2;
+	
+	buffer_reserve(&r->entries, scope.size * sizeof(struct scope_entry));
+	memset(r->entries.data + r->entries.size, 0xff, scope.size * sizeof(struct scope_entry)); // EMPTY_ENTRY everywhere
+	r->entries.size += scope.size * sizeof(struct scope_entry);
+	buffer_append(&r->scopes, (const char*)&scope, sizeof(scope));
+	
+}
+
+void pop_scope(struct resolver* r) {
+	
+	r->scopes.size -= sizeof(struct scope);
+	struct scope* scope = (struct scope*)(r->scopes.data + r->scopes.size);
+	r->entries.size = scope->first * sizeof(struct scope_entry);
+	
+}
+
+struct scope_entry* find_entry(struct resolver* r, struct scope* scope, uint32_t name) { // the entry for name or the empty one it would go into
+	
+	struct scope_entry* table = (struct scope_entry*)r->entries.data + scope->first;
+	uint32_t slot = hash_offset(name) & (scope->size - 1);
+	while(table[slot].name != EMPTY_ENTRY && table[slot].name != name) slot = (slot + 1) & (scope->size - 1);
+	return &table[slot];
+	
+}
+
+struct scope_entry* lookup(struct resolver* r, uint32_t name) { // innermost scope first, NULL if no scope has the name
+	
+	struct scope* scopes = (struct scope*)r->scopes.data;
+	for(size_t i = r->scopes.size / sizeof(struct scope); i--;) {
+		struct scope_entry* entry = find_entry(r, &scopes[i], name);
+		if(entry->name != EMPTY_ENTRY) return entry;
+	}
+	return 0;
+	
+}
+
+struct scope_entry* declare(struct resolver* r, uint32_t name, uint32_t node) { // in the innermost scope, returns the earlier entry for a duplicate
+	
+	struct scope* scope = (struct scope*)(r->scopes.data + r->scopes.size) - 1;
+	struct scope_entry* entry = find_entry(r, scope, name);
+	if(entry->name != EMPTY_ENTRY) return entry;
+	entry->name = name;
+	entry->node = node;
+	return 0;
+	
+}
+
+void assign_symbol(struct resolver* r, uint32_t node, uint32_t parent) {
+	
+	struct ast* ast = r->ast;
+	struct function* function = &ast->functions[ast->lhs[node]];
+	
+	if(parent != NO_NODE) {
+		r->name.size = 0;
+		buffer_append_string(&r->name, ast->strings + ast->functions[ast->lhs[parent]].symbol);
+		buffer_append_char(&r->name, '_');
+		buffer_append_string(&r->name, ast->strings + function->name);
+		function->symbol = intern_string(ast, r->name.data, r->name.size);
+	}
+	
+	// nested functions end up next to all others in C, "a_b" could be a top-level function as well as b in a
+	uint32_t slot = hash_offset(function->symbol) & (r->symbol_table_size - 1);
+	while(r->symbols[slot] && ast->functions[ast->lhs[r->symbols[slot] - 1]].symbol != function->symbol) slot = (slot + 1) & (r->symbol_table_size - 1);
+	if(r->symbols[slot]) {
+		fprintf(stderr, "E: Function \"%s\" in line %d has the same name in the generated code as the one in line %d (\"%s\")!\n", ast->strings + function->name, function->line, ast->functions[ast->lhs[r->symbols[slot] - 1]].line, ast->strings + function->symbol);
+		r->failed = 1;
+		return;
+	}
+	r->symbols[slot] = node + 1;
+	
+}
+
+void resolve_scope(struct resolver* r, uint32_t first, uint32_t end, uint32_t list, uint32_t parent) {
+	
+	struct ast* ast = r->ast;
+	
+	// the functions of a block are visible in all of it, also before their declaration
+	uint32_t count = 0;
+	for(uint32_t i = 1; i <= ast->lists[list]; i++) {
+		if(ast->types[ast->lists[list + i]] == FUNCTION_DECLARATION) count++;
+	}
+	push_scope(r, count);
+	
+	for(uint32_t i = 1; i <= ast->lists[list]; i++) {
+		
+		uint32_t node = ast->lists[list + i];
+		if(ast->types[node] != FUNCTION_DECLARATION) continue;
+		struct function* function = &ast->functions[ast->lhs[node]];
+		
+		struct scope_entry* outer = lookup(r, function->name);
+		if(outer && outer->node == TYPE_ENTRY) {
+			fprintf(stderr, "E: Function \"%s\" in line %d has the name of a type!\n", ast->strings + function->name, function->line);
+			r->failed = 1;
+		}
+		struct scope_entry* previous = declare(r, function->name, node);
+		if(previous) {
+			fprintf(stderr, "E: Function \"%s\" in line %d is already defined in line %d!\n", ast->strings + function->name, function->line, ast->functions[ast->lhs[previous->node]].line);
+			r->failed = 1;
+			continue;
+		}
+		
+		assign_symbol(r, node, parent);
+		
+	}
+	
+	// the nodes of a body are contiguous, nested functions are skipped here and get a scan of their own
+	for(uint32_t node = first; node < end; node++) {
+		switch(ast->types[node]) {
+		case FUNCTION_DECLARATION: {
+			struct function* function = &ast->functions[ast->lhs[node]];
+			struct scope_entry* type = lookup(r, function->return_type);
+			if(!type || type->node != TYPE_ENTRY) {
+				fprintf(stderr, "E: Unknown return type \"%s\" of function \"%s\" in line %d!\n", ast->strings + function->return_type, ast->strings + function->name, function->line);
+				r->failed = 1;
+			}
+			resolve_scope(r, node + 1, function->end, function->body, node);
+			node = function->end - 1;
+			break;
+		}
+		case IDENTIFIER: {
+			struct scope_entry* entry = lookup(r, ast->lhs[node]);
+			if(!entry) fprintf(stderr, "E: Undefined identifier \"%s\" in line %u!\n", ast->strings + ast->lhs[node], ast->rhs[node]);
+			else if(entry->node == TYPE_ENTRY) fprintf(stderr, "E: Type \"%s\" used as a value in line %u!\n", ast->strings + ast->lhs[node], ast->rhs[node]);
+			else fprintf(stderr, "E: Function \"%s\" used as a value in line %u!\n", ast->strings + ast->lhs[node], ast->rhs[node]);
+			r->failed = 1; // nothing declares values yet
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	
+	pop_scope(r);
+	
+}
+
+void free_resolver(void* arg) {
+	
+	struct resolver* r = arg;
+	buffer_free(&r->entries);
+	buffer_free(&r->scopes);
+	buffer_free(&r->name);
+	free(r->symbols);
+	
+}
+
+void resolve(struct ast* ast) {
+	
+	struct resolver r = {ast};
+	push_cleanup(free_resolver, &r);
+	
+	r.symbol_table_size = 16;
+	while(r.symbol_table_size < (uint64_t)ast->function_count * 2) r.symbol_table_size *= 2;
+	r.symbols = calloc(r.symbol_table_size, sizeof(uint32_t));
+	if(!r.symbols) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	
+	size_t type_count = sizeof(builtin_types) / sizeof(builtin_types[0]);
+	push_scope(&r, type_count);
+	for(size_t i = 0; i < type_count; i++) declare(&r, intern_string(ast, builtin_types[i], strlen(builtin_types[i])), TYPE_ENTRY);
+	
+	resolve_scope(&r, 0, ast->node_count, ast->body, NO_NODE);
+	
+	pop_scope(&r);
+	int failed = r.failed;
+	pop_cleanup(1);
+	if(failed) fail();
+	
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "parser.h"
+
+// Checks the names in the AST before any code is generated: identifiers have to name a value in scope
+// and return types have to name a type. Every function body is a scope of its own, and nested functions
+// get their symbols ("outer_inner") here. All errors are reported before it fails.
+void resolve(struct ast* ast);
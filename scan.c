@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+#define W CHAR_WHITESPACE
+#define L CHAR_LETTER
+#define D CHAR_DIGIT
+#define P CHAR_PUNCTUATOR
+#define O CHAR_OPERATOR
+
+const unsigned char char_class[256] = {
+	['\t'] = W, ['\n'] = W, [' '] = W,
+	['a' ... 'z'] = L, ['A' ... 'Z'] = L, ['_'] = L,
+	['0' ... '9'] = D,
+	['('] = P, [')'] = P, ['{'] = P, ['}'] = P, ['['] = P, [']'] = P, [';'] = P, [','] = P,
+	['+'] = O, ['-'] = O, ['*'] = O, ['/'] = O, ['%'] = O, ['='] = O, ['!'] = O, ['<'] = O, ['>'] = O
+};
+
+#undef W
+#undef L
+#undef D
+#undef P
+#undef O
+
+const char* skip_whitespace_scalar(const char* p, size_t* newlines) {
+	
+	while(char_class[(unsigned char)*p] & CHAR_WHITESPACE) {
+		if(*p == '\n') (*newlines)++;
+		p++;
+	}
+	return p;
+	
+}
+
+const char* skip_word_scalar(const char* p) {
+	
+	while(char_class[(unsigned char)*p] & (CHAR_LETTER | CHAR_DIGIT)) p++;
+	return p;
+	
+}
+
+const char* skip_comment_scalar(const char* p) {
+	
+	while(*p != '\n' && *p) p++;
+	return p;
+	
+}
+
+#ifdef SCAN_X86
+
+// The vector kernels only do aligned loads, which can't cross into the next page.
+// Bytes of the first block that come before p are masked as if they were part of the run.
+
+#define IN_RANGE_128(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo) - 1)), _mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), v))
+
+__attribute__((target("sse2"))) const char* skip_whitespace_sse2(const char* p, size_t* newlines) {
+	
+	uintptr_t misalign = (uintptr_t)p & 15;
+	const char* block = p - misalign;
+	uint32_t before = (1u << misalign) - 1;
+	
+	while(1) {
+		__m128i v = _mm_load_si128((const __m128i*)block);
+		__m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+		__m128i ws = _mm_or_si128(nl, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+		uint32_t run = (uint32_t)_mm_movemask_epi8(ws) | before;
+		uint32_t nl_mask = (uint32_t)_mm_movemask_epi8(nl) & ~before;
+		if(run != 0xFFFF) {
+			int end = __builtin_ctz(~run);
+			*newlines += __builtin_popcount(nl_mask & ((1u << end) - 1));
+			return block + end;
+		}
+		*newlines += __builtin_popcount(nl_mask);
+		block += 16;
+		before = 0;
+	}
+	
+}
+
+__attribute__((target("sse2"))) const char* skip_word_sse2(const char* p) {
+	
+	uintptr_t misalign = (uintptr_t)p & 15;
+	const char* block = p - misalign;
+	uint32_t before = (1u << misalign) - 1;
+	
+	while(1) {
+		__m128i v = _mm_load_si128((const __m128i*)block);
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20)); // folds upper case letters onto lower case ones
+		__m128i word = _mm_or_si128(_mm_or_si128(IN_RANGE_128(lower, 'a', 'z'), IN_RANGE_128(v, '0', '9')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+		uint32_t run = (uint32_t)_mm_movemask_epi8(word) | before;
+		if(run != 0xFFFF) return block + __builtin_ctz(~run);
+		block += 16;
+		before = 0;
+	}
+	
+}
+
+__attribute__((target("sse2"))) const char* skip_comment_sse2(const char* p) {
+	
+	uintptr_t misalign = (uintptr_t)p & 15;
+	const char* block = p - misalign;
+	uint32_t before = (1u << misalign) - 1;
+	
+	while(1) {
+		__m128i v = _mm_load_si128((const __m128i*)block);
+		__m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		uint32_t end = (uint32_t)_mm_movemask_epi8(stop) & ~before;
+		if(end) return block + __builtin_ctz(end);
+		block += 16;
+		before = 0;
+	}
+	
+}
+
+#define IN_RANGE_256(v, lo, hi) _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((lo) - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), v))
+#define BEFORE_MASK_32(misalign) ((uint32_t)(((uint64_t)1 << (misalign)) - 1))
+
+__attribute__((target("avx2"))) const char* skip_whitespace_avx2(const char* p, size_t* newlines) {
+	
+	uintptr_t misalign = (uintptr_t)p & 31;
+	const char* block = p - misalign;
+	uint32_t before = BEFORE_MASK_32(misalign);
+	
+	while(1) {
+		__m256i v = _mm256_load_si256((const __m256i*)block);
+		__m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+		__m256i ws = _mm256_or_si256(nl, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+		uint32_t run = (uint32_t)_mm256_movemask_epi8(ws) | before;
+		uint32_t nl_mask = (uint32_t)_mm256_movemask_epi8(nl) & ~before;
+		if(run != 0xFFFFFFFF) {
+			int end = __builtin_ctz(~run);
+			*newlines += __builtin_popcount(nl_mask & BEFORE_MASK_32(end));
+			return block + end;
+		}
+		*newlines += __builtin_popcount(nl_mask);
+		block += 32;
+		before = 0;
+	}
+	
+}
+
+__attribute__((target("avx2"))) const char* skip_word_avx2(const char* p) {
+	
+	uintptr_t misalign = (uintptr_t)p & 31;
+	const char* block = p - misalign;
+	uint32_t before = BEFORE_MASK_32(misalign);
+	
+	while(1) {
+		__m256i v = _mm256_load_si256((const __m256i*)block);
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i word = _mm256_or_si256(_mm256_or_si256(IN_RANGE_256(lower, 'a', 'z'), IN_RANGE_256(v, '0', '9')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+		uint32_t run = (uint32_t)_mm256_movemask_epi8(word) | before;
+		if(run != 0xFFFFFFFF) return block + __builtin_ctz(~run);
+		block += 32;
+		before = 0;
+	}
+	
+}
+
+__attribute__((target("avx2"))) const char* skip_comment_avx2(const char* p) {
+	
+	uintptr_t misalign = (uintptr_t)p & 31;
+	const char* block = p - misalign;
+	uint32_t before = BEFORE_MASK_32(misalign);
+	
+	while(1) {
+		__m256i v = _mm256_load_si256((const __m256i*)block);
+		__m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		uint32_t end = (uint32_t)_mm256_movemask_epi8(stop) & ~before;
+		if(end) return block + __builtin_ctz(end);
+		block += 32;
+		before = 0;
+	}
+	
+}
+
+#endif
+
+struct scan_kernels scan = {
+	skip_whitespace_scalar,
+	skip_word_scalar,
+	skip_comment_scalar
+};
+
+__attribute__((constructor)) void select_scan_kernels() {
+	
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		scan = (struct scan_kernels){skip_whitespace_avx2, skip_word_avx2, skip_comment_avx2};
+	} else if(__builtin_cpu_supports("sse2")) {
+		scan = (struct scan_kernels){skip_whitespace_sse2, skip_word_sse2, skip_comment_sse2};
+	}
+#endif
+	
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stddef.h>
+
+enum char_class {
+	CHAR_WHITESPACE = 1,
+	CHAR_LETTER = 2, // includes the underscore
+	CHAR_DIGIT = 4,
+	CHAR_PUNCTUATOR = 8,
+	CHAR_OPERATOR = 16
+};
+
+extern const unsigned char char_class[256];
+
+// All of these scan a NUL-terminated string and return a pointer to the first character that doesn't belong to the run.
+// They may read past the end of the run, but never past the end of the page that holds the terminating NUL.
+struct scan_kernels {
+	const char* (*whitespace)(const char* p, size_t* newlines); // adds the number of skipped newlines to *newlines
+	const char* (*word)(const char* p); // letters and digits
+	const char* (*comment)(const char* p); // everything up to a newline or the end of the string
+};
+
+extern struct scan_kernels scan; // picked for the running CPU at startup
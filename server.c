@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "server.h"
+#include "buffer.h"
+#include "error.h"
+#include "report.h"
+
+#define MAX_REQUEST_SIZE (1024 * 1024)
+#define REQUEST_TIMEOUT 10 // seconds a client gets to send its request, and to take the response
+
+const char* socket_path; // relative to saved_cwd
+int saved_cwd = -1;
+
+void remove_socket(int sig) {
+	
+	if(saved_cwd >= 0 && fchdir(saved_cwd)) _exit(128 + sig); // a request may have changed the working directory
+	unlink(socket_path);
+	_exit(128 + sig);
+	
+}
+
+int make_address(const char* path, struct sockaddr_un* addr) {
+	
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "E: Socket path \"%s\" is too long!\n", path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+	
+}
+
+int read_all(int fd, void* data, size_t size) {
+	
+	for(size_t done = 0; done < size;) {
+		ssize_t ret = read(fd, (char*)data + done, size - done);
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret <= 0) return -1;
+		done += ret;
+	}
+	return 0;
+	
+}
+
+int write_all(int fd, const void* data, size_t size) {
+	
+	for(size_t done = 0; done < size;) {
+		ssize_t ret = write(fd, (const char*)data + done, size - done);
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret < 0) return -1;
+		done += ret;
+	}
+	return 0;
+	
+}
+
+// request: uint32 size, then size bytes of NUL-terminated strings (working directory, then the arguments),
+// the client's stdin, stdout and stderr arrive as SCM_RIGHTS on the first byte
+// response: int32 exit status
+
+void close_received_fds(struct msghdr* msg) { // whatever the kernel has installed already, however many there are
+	
+	for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for(size_t i = 0; i < count; i++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			close(fd);
+		}
+	}
+	
+}
+
+int receive_request(int conn, int fds[3], char** payload, uint32_t* size) {
+	
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	struct iovec iov = {size, sizeof(*size)};
+	struct msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	
+	ssize_t ret;
+	do ret = recvmsg(conn, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	while(ret < 0 && errno == EINTR);
+	if(ret < 0) return -1;
+	
+	// a truncated control message could have lost some of the fds, and all of the right ones are needed
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if(ret != sizeof(*size) || (msg.msg_flags & MSG_CTRUNC) || !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+		|| cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)) || CMSG_NXTHDR(&msg, cmsg)) {
+		close_received_fds(&msg);
+		return -1;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+	
+	if(!*size || *size > MAX_REQUEST_SIZE) goto fail;
+	*payload = malloc(*size);
+	if(!*payload) goto fail;
+	if(read_all(conn, *payload, *size) || (*payload)[*size - 1]) {
+		free(*payload);
+		goto fail;
+	}
+	return 0;
+	
+fail:
+	for(int i = 0; i < 3; i++) close(fds[i]);
+	return -1;
+	
+}
+
+// A request runs in the server process itself, after taking over the client's stdin, stdout, stderr and working
+// directory. The server's own ones are put back however the request ends, or the server has to stop.
+void restore_server(int saved_fds[3]) {
+	
+	fflush(stdout);
+	fflush(stderr);
+	int failed = 0;
+	for(int i = 0; i < 3; i++) {
+		if(dup2(saved_fds[i], i) < 0) failed = 1;
+	}
+	if(fchdir(saved_cwd)) failed = 1;
+	if(failed) {
+		fprintf(stderr, "E: Failed to restore the server's file descriptors or working directory!\n");
+		unlink(socket_path);
+		exit(1);
+	}
+	
+}
+
+int handle_request(int conn, int (*compile)(int argc, char** argv), int saved_fds[3]) {
+	
+	int fds[3];
+	char* payload;
+	uint32_t size;
+	if(receive_request(conn, fds, &payload, &size)) return -1;
+	
+	size_t argc = 0;
+	for(uint32_t i = 0; i < size; i++) {
+		if(!payload[i]) argc++; // the working directory takes the place of argv[0]
+	}
+	char* argv[argc + 1];
+	argv[0] = "caro";
+	char* cwd = payload;
+	char* p = payload + strlen(payload) + 1;
+	for(size_t i = 1; i < argc; i++) {
+		argv[i] = p;
+		p += strlen(p) + 1;
+	}
+	argv[argc] = 0;
+	
+	volatile int status = 1;
+	fflush(stdout);
+	fflush(stderr);
+	int redirected = 1;
+	for(int i = 0; i < 3; i++) {
+		if(dup2(fds[i], i) < 0) redirected = 0;
+	}
+	
+	if(!redirected) {
+		fprintf(stderr, "E: Failed to take over the client's file descriptors!\n");
+	} else if(chdir(cwd)) {
+		fprintf(stderr, "E: Failed to change into \"%s\"!\n", cwd);
+	} else {
+		struct error_handler handler;
+		if(!setjmp(handler.jump)) {
+			push_error_handler(&handler);
+			status = compile(argc, argv);
+			pop_error_handler(&handler);
+		}
+	}
+	
+	restore_server(saved_fds);
+	for(int i = 0; i < 3; i++) close(fds[i]);
+	free(payload);
+	
+	int32_t response = status;
+	return write_all(conn, &response, sizeof(response));
+	
+}
+
+int run_server(const char* path, int (*compile)(int argc, char** argv)) {
+	
+	struct sockaddr_un addr;
+	if(make_address(path, &addr)) return 1;
+	
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(sock < 0) {
+		fprintf(stderr, "E: Failed to create socket!\n");
+		return 1;
+	}
+	unlink(path); // left over from a server that didn't shut down cleanly
+	if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) || listen(sock, 64)) {
+		fprintf(stderr, "E: Failed to listen on \"%s\"!\n", path);
+		close(sock);
+		return 1;
+	}
+	
+	socket_path = path;
+	report_resident = 1; // the peak RSS of the process is the one of the largest compilation so far
+	signal(SIGINT, remove_socket);
+	signal(SIGTERM, remove_socket);
+	signal(SIGPIPE, SIG_IGN); // clients may go away while we write to them
+	
+	int saved_fds[3];
+	for(int i = 0; i < 3; i++) saved_fds[i] = fcntl(i, F_DUPFD_CLOEXEC, 3);
+	saved_cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(saved_fds[0] < 0 || saved_fds[1] < 0 || saved_fds[2] < 0 || saved_cwd < 0) {
+		fprintf(stderr, "E: Failed to save the server's file descriptors or working directory!\n");
+		unlink(path);
+		close(sock);
+		return 1;
+	}
+	
+	uid_t uid = getuid();
+	struct timeval timeout = {REQUEST_TIMEOUT, 0};
+	while(1) {
+		int conn = accept4(sock, 0, 0, SOCK_CLOEXEC);
+		if(conn < 0) continue;
+		
+		// requests run arbitrary commands through --pgo-train, so only the server's own user may send them
+		struct ucred cred;
+		socklen_t cred_size = sizeof(cred);
+		if(getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_size) || cred.uid != uid) {
+			fprintf(stderr, "W: Rejected a connection from another user!\n");
+			close(conn);
+			continue;
+		}
+		
+		// a client that stalls mustn't block the server, the compilation itself isn't limited
+		setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		handle_request(conn, compile, saved_fds);
+		close(conn);
+	}
+	
+}
+
+int run_client(const char* path, int argc, char** argv) {
+	
+	struct sockaddr_un addr;
+	if(make_address(path, &addr)) return 1;
+	
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr))) {
+		fprintf(stderr, "E: Failed to connect to the compile server at \"%s\"!\n", path);
+		if(sock >= 0) close(sock);
+		return 1;
+	}
+	
+	signal(SIGPIPE, SIG_IGN); // the server closes connections it rejects, that is reported below
+	
+	struct buffer payload = {0};
+	char* cwd = getcwd(0, 0);
+	if(!cwd) {
+		fprintf(stderr, "E: Failed to get the working directory!\n");
+		close(sock);
+		return 1;
+	}
+	buffer_append(&payload, cwd, strlen(cwd) + 1);
+	free(cwd);
+	for(int i = 1; i < argc; i++) buffer_append(&payload, argv[i], strlen(argv[i]) + 1);
+	
+	uint32_t size = payload.size;
+	int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	char control[CMSG_SPACE(sizeof(fds))];
+	memset(control, 0, sizeof(control));
+	struct iovec iov = {&size, sizeof(size)};
+	struct msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	
+	int32_t status;
+	if(sendmsg(sock, &msg, 0) != sizeof(size) || write_all(sock, payload.data, payload.size) || read_all(sock, &status, sizeof(status))) {
+		fprintf(stderr, "E: Lost the connection to the compile server!\n");
+		status = 1;
+	}
+	
+	buffer_free(&payload);
+	close(sock);
+	return status;
+	
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// A compile server runs compile() for every request in the same process. The client sends its working
+// directory, its arguments and its stdin, stdout and stderr file descriptors, and gets the exit status back.
+
+int run_server(const char* path, int (*compile)(int argc, char** argv)); // only returns if the socket can't be set up
+int run_client(const char* path, int argc, char** argv); // argv[0] is skipped like in main()
@@ -0,0 +1,17 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+struct sha256 {
+	uint32_t state[8];
+	uint64_t length; // total bytes hashed so far
+	unsigned char block[64];
+	size_t block_size;
+};
+
+void sha256_init(struct sha256* ctx);
+void sha256_update(struct sha256* ctx, const void* data, size_t size);
+void sha256_final(struct sha256* ctx, unsigned char digest[SHA256_SIZE]);
+void sha256_hex(const unsigned char digest[SHA256_SIZE], char hex[2 * SHA256_SIZE + 1]);
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input.h"
+#include "lexer.h"
+#include "reference_lexer.h"
+#include "frontend.h"
+#include "error.h"
+
+// Prints the tokens of a file one per line, for test/lexer_test.sh to compare. Errors go to stderr like in caro.
+int main(int argc, char** argv) {
+	
+	int reference = 0;
+	size_t chunks = 0;
+	const char* path = 0;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp("-r", argv[i])) reference = 1;
+		else if(!strcmp("-c", argv[i]) && i + 1 < argc) chunks = strtoul(argv[++i], 0, 10);
+		else path = argv[i];
+	}
+	if(!path) {
+		fprintf(stderr, "Usage: lexdump [-r | -c chunks] file\n");
+		fprintf(stderr, "\t-r - use the reference lexer\n");
+		fprintf(stderr, "\t-c chunks - use tokenize_parallel() with that many chunks, however small they get\n");
+		return 1;
+	}
+	
+	struct source source = read_source(path);
+	struct token* tokens;
+	if(reference) tokens = reference_tokenize(source.data, source.size);
+	else if(chunks) tokens = tokenize_parallel(source.data, source.size, chunks);
+	else tokens = tokenize(source.data, source.size);
+	
+	for(size_t i = 0;; i++) {
+		struct token* token = &tokens[i];
+		uint64_t position = token->type == TOKEN_INTEGER_LITERAL ? token->value : token->offset;
+		printf("%d %d %d %u %llu\n", token->type, token->kind, token->line, token->length, (unsigned long long)position);
+		if(token->type == TOKEN_END) break;
+	}
+	
+	free(tokens);
+	free_source(&source);
+	return 0;
+	
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Lexes examples/, test/lexer/ and generated sources with the reference lexer, tokenize() and tokenize_parallel()
+# and compares the token dumps and errors. Run through "make test".
+cd "$(dirname "$0")/.." || exit 1
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+check() { # file name
+	./test/lexdump -r "$1" > "$tmp/expected" 2>&1
+	echo "exit $?" >> "$tmp/expected"
+	for lexer in "" "-c 3" "-c 16"; do
+		./test/lexdump $lexer "$1" > "$tmp/actual" 2>&1
+		echo "exit $?" >> "$tmp/actual"
+		if cmp -s "$tmp/expected" "$tmp/actual"; then
+			echo "PASS lexer $2${lexer:+ ($lexer)}"
+		else
+			echo "FAIL lexer $2${lexer:+ ($lexer)}"
+			diff "$tmp/expected" "$tmp/actual" | head -n 6
+			failed=1
+		fi
+	done
+}
+
+for file in examples/*.caro test/lexer/*.caro; do
+	check "$file" "$file"
+done
+
+# the source ends right before, at and after a page boundary, in the middle of a literal
+for size in 4095 4096 4097 8192; do
+	{ printf 'fn main() -> i64 {\n\treturn 1'; head -c $((size - 21)) /dev/zero | tr '\0' '7'; printf ';\n}'; } | head -c "$size" > "$tmp/page.caro"
+	check "$tmp/page.caro" "page boundary at $size bytes"
+done
+
+for workload in expressions nested identifiers comments mixed tables; do
+	for seed in 1 2 3; do
+		./bench/gen "$workload" 1000000 "$seed" > "$tmp/source.caro"
+		check "$tmp/source.caro" "$workload (seed $seed)"
+	done
+done
+
+exit $failed
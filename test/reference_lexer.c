@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reference_lexer.h"
+#include "error.h"
+
+// One character at a time and without any of the tables, word tricks or vector scans of lexer.c, so it's easy to
+// check by reading. It has to produce the same tokens and the same errors.
+
+int reference_is_letter(char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+int reference_is_digit(char ch) {
+	return ch >= '0' && ch <= '9';
+}
+
+int digit_value(char ch) { // 16 for anything that isn't a hex digit
+	
+	if(ch >= '0' && ch <= '9') return ch - '0';
+	if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+	if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+	return 16;
+	
+}
+
+struct reference_tokens {
+	struct token* data;
+	size_t size;
+	size_t capacity;
+};
+
+void free_reference_tokens(void* tokens) {
+	
+	free(((struct reference_tokens*)tokens)->data);
+	
+}
+
+struct token* add_token(struct reference_tokens* tokens, enum token_type type, int kind, int line, size_t offset, size_t length) {
+	
+	if(tokens->size == tokens->capacity) {
+		tokens->capacity = tokens->capacity ? tokens->capacity * 2 : 256;
+		tokens->data = realloc(tokens->data, tokens->capacity * sizeof(struct token));
+		if(!tokens->data) {
+			fprintf(stderr, "E: Failed to allocate memory!\n");
+			fail();
+		}
+	}
+	struct token* token = &tokens->data[tokens->size++];
+	memset(token, 0, sizeof(*token));
+	token->type = type;
+	token->kind = kind;
+	token->line = line;
+	token->length = length;
+	token->offset = offset;
+	return token;
+	
+}
+
+struct token* reference_tokenize(const char* source, size_t size) {
+	
+	static const char* punctuators = "(){}[];,";
+	static const char* operators[] = {"->", "==", "!=", "<=", ">=", "+", "-", "*", "/", "%", "=", "!", "<", ">"};
+	static const int operator_kinds[] = {
+		OPERATOR_ARROW, OPERATOR_EQUAL, OPERATOR_NOT_EQUAL, OPERATOR_LESS_EQUAL, OPERATOR_GREATER_EQUAL,
+		OPERATOR_PLUS, OPERATOR_MINUS, OPERATOR_ASTERISK, OPERATOR_SLASH, OPERATOR_PERCENT, OPERATOR_ASSIGN, OPERATOR_NOT, OPERATOR_LESS, OPERATOR_GREATER
+	};
+	
+	struct reference_tokens tokens = {0};
+	push_cleanup(free_reference_tokens, &tokens);
+	int line = 1;
+	size_t i = 0;
+	
+	while(i < size) {
+		
+		char ch = source[i];
+		if(ch == ' ' || ch == '\t' || ch == '\n') {
+			if(ch == '\n') line++;
+			i++;
+			continue;
+		}
+		if(ch == '#') {
+			while(source[i] && source[i] != '\n') i++;
+			continue;
+		}
+		if(reference_is_letter(ch)) {
+			size_t start = i;
+			while(reference_is_letter(source[i]) || reference_is_digit(source[i])) i++;
+			size_t length = i - start;
+			if(length == 2 && !memcmp(&source[start], "fn", 2)) add_token(&tokens, TOKEN_KEYWORD, KEYWORD_FN, line, start, length);
+			else if(length == 6 && !memcmp(&source[start], "return", 6)) add_token(&tokens, TOKEN_KEYWORD, KEYWORD_RETURN, line, start, length);
+			else add_token(&tokens, TOKEN_IDENTIFIER, 0, line, start, length);
+			continue;
+		}
+		if(reference_is_digit(ch)) {
+			size_t start = i;
+			int base = 10;
+			if(ch == '0' && source[i + 1] == 'b') base = 2;
+			if(ch == '0' && source[i + 1] == 'o') base = 8;
+			if(ch == '0' && source[i + 1] == 'x') base = 16;
+			if(base != 10) i += 2;
+			size_t digits = i;
+			uint64_t value = 0;
+			int overflow = 0;
+			while(digit_value(source[i]) < base) {
+				overflow |= __builtin_mul_overflow(value, (uint64_t)base, &value);
+				overflow |= __builtin_add_overflow(value, (uint64_t)digit_value(source[i]), &value);
+				i++;
+			}
+			if(i == digits || reference_is_letter(source[i]) || reference_is_digit(source[i])) {
+				fprintf(stderr, "E: Invalid integer literal in line %d!\n", line);
+				fail();
+			}
+			if(overflow) {
+				fprintf(stderr, "E: Integer literal in line %d doesn't fit into 64 bits!\n", line);
+				fail();
+			}
+			enum literal_width width = value <= INT32_MAX ? LITERAL_32 : value <= INT64_MAX ? LITERAL_64 : LITERAL_64_UNSIGNED;
+			add_token(&tokens, TOKEN_INTEGER_LITERAL, width, line, 0, i - start)->value = value;
+			continue;
+		}
+		if(ch && strchr(punctuators, ch)) {
+			add_token(&tokens, TOKEN_PUNCTUATOR, PUNCTUATOR_OPEN_PAREN + (strchr(punctuators, ch) - punctuators), line, i, 1);
+			i++;
+			continue;
+		}
+		int is_operator = 0;
+		for(size_t j = 0; j < sizeof(operators) / sizeof(operators[0]); j++) {
+			size_t length = strlen(operators[j]);
+			if(!strncmp(&source[i], operators[j], length)) {
+				add_token(&tokens, TOKEN_OPERATOR, operator_kinds[j], line, i, length);
+				i += length;
+				is_operator = 1;
+				break;
+			}
+		}
+		if(is_operator) continue;
+		if(ch == '"') {
+			size_t start = i++;
+			while(source[i] != '"') {
+				if(source[i] == '\\') {
+					i++;
+					if(source[i] != 'n' && source[i] != 't' && source[i] != '\\' && source[i] != '"') {
+						fprintf(stderr, "E: Invalid escape sequence in line %d!\n", line);
+						fail();
+					}
+				} else if(source[i] == 0 || source[i] == '\n') {
+					fprintf(stderr, "Unclosed string literal in line %d!\n", line);
+					fail();
+				}
+				i++;
+			}
+			i++;
+			add_token(&tokens, TOKEN_STRING_LITERAL, 0, line, start, i - start);
+			continue;
+		}
+		fprintf(stderr, "E: Invalid token in line %d: %c\n", line, ch);
+		fail();
+		
+	}
+	
+	add_token(&tokens, TOKEN_END, 0, line, size, 0);
+	pop_cleanup(0);
+	return tokens.data;
+	
+}
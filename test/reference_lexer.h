@@ -0,0 +1,5 @@
+#pragma once
+#include "lexer.h"
+
+// The token contract of tokenize(), implemented as plainly as possible, for comparing the real lexer against.
+struct token* reference_tokenize(const char* source, size_t size); // source[size] has to be NUL
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "parser.h"
+#include "resolve.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "native.h"
+#include "buffer.h"
+#include "optimize.c" // for expression_width() and the optimizer, the Makefile leaves it out of the linked sources
+
+// Checks what optimize() makes of x + 0, x * 0 and multiplication, division and modulo by powers of two, which only
+// ever reach the backends with an operand that isn't constant. Nothing declares values yet, so the expressions use
+// an undeclared x, resolve() is skipped and x is given a width here where that matters. Writes to the directory in
+// argv[1]: check.c, which gcc has to compile and run to compare the C from before and after optimize() for an int
+// and a long x, and a native executable for each rewritten operation, whose exit status is printed next to it.
+// test/simplify_test.sh does all of that.
+
+struct simplification {
+	const char* source; // an expression of x
+	const char* simplified[3]; // the C for it with x of an unknown width, and with x declared int or long
+	int operation[3]; // of the simplified expression, -1 if it isn't a binary one anymore
+	uint64_t constant; // the right operand of a binary one, if it's a literal
+	enum literal_width constant_width;
+};
+
+// 9223372036854775808 is the only power of two above LONG_MAX, dividing it makes an unsigned long constant
+#define EIGHT_UNSIGNED "(9223372036854775808 / 1152921504606846976)"
+
+struct simplification simplifications[] = {
+	{"x * 8", {"(x<<3)", "(x<<3)", "(x<<3)"}, {OP_SHIFT_LEFT, OP_SHIFT_LEFT, OP_SHIFT_LEFT}, 3, LITERAL_32},
+	{"8 * x", {"(x<<3)", "(x<<3)", "(x<<3)"}, {OP_SHIFT_LEFT, OP_SHIFT_LEFT, OP_SHIFT_LEFT}, 3, LITERAL_32},
+	{"x / " EIGHT_UNSIGNED, {"((u64)x>>3)", "((u64)x>>3)", "((u64)x>>3)"}, {OP_SHIFT_RIGHT, OP_SHIFT_RIGHT, OP_SHIFT_RIGHT}, 3, LITERAL_32},
+	{"x % " EIGHT_UNSIGNED, {"(x&7UL)", "(x&7UL)", "(x&7UL)"}, {OP_AND, OP_AND, OP_AND}, 7, LITERAL_64_UNSIGNED},
+	{"x * 0", {"(x*0)", "0", "0L"}, {OP_MULTIPLY, -1, -1}, 0, LITERAL_32}, // only folded once the width of x is known
+	{"x + 0", {"x", "x", "x"}, {-1, -1, -1}},
+	{"0 + x", {"x", "x", "x"}, {-1, -1, -1}},
+	{"x - 0", {"x", "x", "x"}, {-1, -1, -1}},
+	{"x * 1", {"x", "x", "x"}, {-1, -1, -1}},
+	{"x / 1", {"x", "x", "x"}, {-1, -1, -1}},
+	{"x / 8", {"(x/8)", "(x/8)", "(x/8)"}, {OP_DIVIDE, OP_DIVIDE, OP_DIVIDE}, 8, LITERAL_32}, // rounds towards zero
+	{"x % 8", {"(x%8)", "(x%8)", "(x%8)"}, {OP_MODULO, OP_MODULO, OP_MODULO}, 8, LITERAL_32},
+	{"x * 4294967296", {"(x*4294967296L)", "(x*4294967296L)", "(x*4294967296L)"}, {OP_MULTIPLY, OP_MULTIPLY, OP_MULTIPLY}, 4294967296, LITERAL_64},
+	{"x * 6", {"(x*6)", "(x*6)", "(x*6)"}, {OP_MULTIPLY, OP_MULTIPLY, OP_MULTIPLY}, 6, LITERAL_32},
+};
+
+#define SIMPLIFICATION_COUNT (sizeof(simplifications) / sizeof(simplifications[0]))
+
+// The lowering of the operations simplify() makes, by the interpreter and the native backend: the right operand of
+// source, a literal, is given the width before the rewrite, then the expression becomes left operation constant.
+struct lowering_case {
+	const char* source; // main's return value
+	enum literal_width width;
+	enum binary_operation operation;
+	uint64_t constant;
+	enum literal_width constant_width;
+	int native; // whether the native backend can build the rewritten expression, it only has 32-bit literals
+};
+
+struct lowering_case lowering_cases[] = {
+	{"(0 - 5) * 8", LITERAL_32, OP_SHIFT_LEFT, 3, LITERAL_32, 1},
+	{"(0 - 4294967301) * 8", LITERAL_32, OP_SHIFT_LEFT, 3, LITERAL_32, 0},
+	{"(0 - 40) / 8", LITERAL_64_UNSIGNED, OP_SHIFT_RIGHT, 3, LITERAL_32, 1},
+	{"(0 - 40) / 1152921504606846976", LITERAL_64_UNSIGNED, OP_SHIFT_RIGHT, 60, LITERAL_32, 1}, // the sign bits make the exit status
+	{"(0 - 37) % 8", LITERAL_64_UNSIGNED, OP_AND, 7, LITERAL_64_UNSIGNED, 1},
+	{"1000 % 64", LITERAL_64_UNSIGNED, OP_AND, 63, LITERAL_64_UNSIGNED, 1},
+};
+
+#define LOWERING_CASE_COUNT (sizeof(lowering_cases) / sizeof(lowering_cases[0]))
+
+// optimize() with x declared of the given width: the same pass, the only difference is the width of identifiers
+void optimize_declared(struct ast* ast, enum literal_width width) {
+	
+	struct optimizer o = {ast};
+	o.widths = malloc(ast->node_count ? ast->node_count : 1);
+	if(!o.widths) {
+		fprintf(stderr, "E: Failed to allocate memory!\n");
+		fail();
+	}
+	for(uint32_t node = 0; node < ast->node_count; node++) {
+		if(ast->types[node] == BINARY_EXPRESSION) {
+			int constant_left = ast->types[ast->lhs[node]] == NUMERIC_LITERAL;
+			int constant_right = ast->types[ast->rhs[node]] == NUMERIC_LITERAL;
+			if(constant_left && constant_right) fold_constants(&o, node);
+			else if(constant_left || constant_right) simplify(&o, node);
+		}
+		o.widths[node] = ast->types[node] == IDENTIFIER ? width : expression_width(&o, node);
+	}
+	free(o.widths);
+	buffer_free(&o.functions);
+	if(o.failed) fail();
+	
+}
+
+// The return statements of f, one for each simplification.
+struct ast* parse_simplifications(struct token** tokens, struct buffer* source) {
+	
+	buffer_append_string(source, "fn f() -> i64 {\n");
+	for(size_t i = 0; i < SIMPLIFICATION_COUNT; i++) {
+		buffer_append_string(source, "return ");
+		buffer_append_string(source, simplifications[i].source);
+		buffer_append_string(source, ";\n");
+	}
+	buffer_append_string(source, "}\n");
+	buffer_append_char(source, 0);
+	*tokens = tokenize(source->data, source->size - 1);
+	return parse(*tokens, source->data);
+	
+}
+
+void append_expression(struct buffer* out, struct ast* ast, uint32_t statement) { // of a return statement
+	
+	struct buffer c = {0};
+	generate_c_statement(ast, statement, &c, LINKAGE_EXTERNAL);
+	const char* start = "return ";
+	if(c.size <= strlen(start) || memcmp(c.data, start, strlen(start))) {
+		fprintf(stderr, "The generated return statement doesn't start with \"%s\"!\n", start);
+		exit(1);
+	}
+	buffer_append(out, c.data + strlen(start), c.size - strlen(start));
+	buffer_free(&c);
+	
+}
+
+// mode is 0 for an unknown width of x, 1 for int and 2 for long.
+int check_simplifications(int mode, struct buffer simplified[]) {
+	
+	static const char* names[] = {"undeclared", "int", "long"};
+	struct token* tokens;
+	struct buffer source = {0};
+	struct ast* ast = parse_simplifications(&tokens, &source);
+	if(mode) optimize_declared(ast, mode == 1 ? LITERAL_32 : LITERAL_64);
+	else optimize(ast);
+	
+	int failed = 0;
+	uint32_t* body = &ast->lists[ast->functions[0].body];
+	for(size_t i = 0; i < SIMPLIFICATION_COUNT; i++) {
+		struct simplification* s = &simplifications[i];
+		uint32_t expr = ast->lhs[body[i + 1]];
+		simplified[i].size = 0;
+		append_expression(&simplified[i], ast, body[i + 1]);
+		buffer_append_char(&simplified[i], 0);
+		if(strcmp(simplified[i].data, s->simplified[mode])) {
+			fprintf(stderr, "%s with %s x: optimize() made %s of it, expected %s\n", s->source, names[mode], simplified[i].data, s->simplified[mode]);
+			failed = 1;
+		}
+		
+		int operation = ast->types[expr] == BINARY_EXPRESSION ? ast->operators[expr] : -1;
+		if(operation != s->operation[mode]) {
+			fprintf(stderr, "%s with %s x: the operation is %d, expected %d\n", s->source, names[mode], operation, s->operation[mode]);
+			failed = 1;
+		} else if(operation >= 0 && ast->types[ast->rhs[expr]] == NUMERIC_LITERAL) {
+			uint32_t constant = ast->rhs[expr];
+			if(literal_value(ast, constant) != s->constant || ast->operators[constant] != s->constant_width) {
+				fprintf(stderr, "%s with %s x: the constant is %lu of width %d, expected %lu of width %d\n", s->source, names[mode], (unsigned long)literal_value(ast, constant), ast->operators[constant], (unsigned long)s->constant, s->constant_width);
+				failed = 1;
+			}
+		}
+	}
+	
+	free_ast(ast);
+	free(tokens);
+	buffer_free(&source);
+	return failed;
+	
+}
+
+// check.c compares every simplified expression to the unsimplified one for x from -20 to 20, by value and by type.
+void write_check(const char* path, struct buffer simplified[3][SIMPLIFICATION_COUNT]) {
+	
+	struct token* tokens;
+	struct buffer source = {0};
+	struct ast* ast = parse_simplifications(&tokens, &source);
+	uint32_t* body = &ast->lists[ast->functions[0].body];
+	
+	struct buffer out = {0};
+	generate_c_prelude(&out);
+	buffer_append_string(&out, "\n#include <stdio.h>\n");
+	buffer_append_string(&out, "#define TYPE(e) _Generic((e), i32: 0, i64: 1, u64: 2, default: 3)\n");
+	buffer_append_string(&out, "const char* types[] = {\"int\", \"long\", \"unsigned long\", \"something else\"};\n");
+	buffer_append_string(&out, "#define CHECK(source, before, after) if(TYPE(before) != TYPE(after) || (before) != (after)) { \\\n");
+	buffer_append_string(&out, "\tprintf(\"%s with %s x = %ld: %s is %s %lu, it was %s %lu\\n\", source, types[TYPE(x)], (long)x, #after, types[TYPE(after)], (unsigned long)(after), types[TYPE(before)], (unsigned long)(before)); \\\n");
+	buffer_append_string(&out, "\tfailed = 1; }\n");
+	static const char* declarations[] = {"i32", "i64"};
+	for(int d = 0; d < 2; d++) {
+		buffer_append_string(&out, "int check_");
+		buffer_append_string(&out, declarations[d]);
+		buffer_append_string(&out, "(void) {\nint failed = 0;\nfor(");
+		buffer_append_string(&out, declarations[d]);
+		buffer_append_string(&out, " x = -20; x <= 20; x++) {\n");
+		for(size_t i = 0; i < SIMPLIFICATION_COUNT; i++) {
+			for(int mode = 0; mode < 3; mode++) {
+				if(mode && mode != d + 1) continue; // the declared width has to be the one of x
+				buffer_append_string(&out, "CHECK(\"");
+				buffer_append_string(&out, simplifications[i].source);
+				buffer_append_string(&out, "\", ");
+				append_expression(&out, ast, body[i + 1]);
+				buffer_append_string(&out, ", ");
+				buffer_append_string(&out, simplified[mode][i].data);
+				buffer_append_string(&out, ")\n");
+			}
+		}
+		buffer_append_string(&out, "}\nreturn failed;\n}\n");
+	}
+	buffer_append_string(&out, "int main(void) {\nreturn check_i32() | check_i64();\n}\n");
+	FILE* file = fopen(path, "w");
+	if(!file || fwrite(out.data, 1, out.size, file) != out.size || fclose(file)) {
+		fprintf(stderr, "Failed to write \"%s\"!\n", path);
+		exit(1);
+	}
+	
+	buffer_free(&out);
+	free_ast(ast);
+	free(tokens);
+	buffer_free(&source);
+	
+}
+
+int check_lowering(struct lowering_case* c, const char* dir, size_t index) {
+	
+	struct buffer source = {0};
+	buffer_append_string(&source, "fn main() -> i32 {\nreturn ");
+	buffer_append_string(&source, c->source);
+	buffer_append_string(&source, ";\n}\n");
+	buffer_append_char(&source, 0);
+	struct token* tokens = tokenize(source.data, source.size - 1);
+	struct ast* ast = parse(tokens, source.data);
+	resolve(ast);
+	
+	uint32_t* body = &ast->lists[ast->functions[0].body];
+	uint32_t expr = ast->lhs[body[1]];
+	uint32_t constant = ast->rhs[expr];
+	set_literal(ast, constant, literal_value(ast, constant), c->width);
+	int before = interpret(ast);
+	ast->operators[expr] = c->operation;
+	set_literal(ast, constant, c->constant, c->constant_width);
+	int after = interpret(ast);
+	
+	int failed = 0;
+	if(after != before) {
+		fprintf(stderr, "%s: the interpreter returns %d after the rewrite to operation %d, %d before\n", c->source, after, c->operation, before);
+		failed = 1;
+	}
+	if(c->native) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/native%zu", dir, index);
+		build_native(ast, path);
+		printf("%s %d %s\n", path, before & 0xff, c->source); // the exit status of the rewritten expression
+	}
+	
+	free_ast(ast);
+	free(tokens);
+	buffer_free(&source);
+	return failed;
+	
+}
+
+int main(int argc, char** argv) {
+	
+	if(argc != 2) {
+		fprintf(stderr, "Usage: simplify dir\n");
+		return 1;
+	}
+	
+	int failed = 0;
+	struct buffer simplified[3][SIMPLIFICATION_COUNT];
+	memset(simplified, 0, sizeof(simplified));
+	for(int mode = 0; mode < 3; mode++) failed |= check_simplifications(mode, simplified[mode]);
+	
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/check.c", argv[1]);
+	write_check(path, simplified);
+	for(size_t i = 0; i < LOWERING_CASE_COUNT; i++) failed |= check_lowering(&lowering_cases[i], argv[1], i);
+	
+	for(int mode = 0; mode < 3; mode++) {
+		for(size_t i = 0; i < SIMPLIFICATION_COUNT; i++) buffer_free(&simplified[mode][i]);
+	}
+	return failed;
+	
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Runs test/simplify, which checks the expressions optimize() simplifies and writes the C to compare them before and
+# after and native executables of the operations it rewrites them to; this compiles and runs all of it. Run through
+# "make test".
+cd "$(dirname "$0")/.." || exit 1
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+report() { # status name
+	if [ "$1" = 0 ]; then
+		echo "PASS simplify $2"
+	else
+		echo "FAIL simplify $2"
+		cat "$tmp/errors"
+		failed=1
+	fi
+}
+
+./test/simplify "$tmp" > "$tmp/native" 2> "$tmp/errors"
+report $? "optimize() and the interpreter"
+gcc -o "$tmp/check" "$tmp/check.c" > "$tmp/errors" 2>&1 && "$tmp/check" > "$tmp/errors" 2>&1
+report $? "generated C before and after optimize()"
+while read -r executable status source; do
+	"$executable"
+	actual=$?
+	echo "$source: exit status $actual, expected $status" > "$tmp/errors"
+	[ "$actual" = "$status" ]
+	report $? "$source (native)"
+done < "$tmp/native"
+
+exit $failed
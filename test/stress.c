@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frontend.h"
+#include "resolve.h"
+#include "optimize.h"
+#include "generator.h"
+#include "buffer.h"
+#include "error.h"
+#include "bench/workload.h"
+
+// Compiles one function of the chain or deep workload (STRESS_TERMS terms) to C, before and after optimize(), and
+// compares that to C built straight from its tokens. test/stress_test.sh runs it with a small stack.
+
+const char* binary_operator(struct token* token) {
+	
+	if(token->type != TOKEN_OPERATOR) return 0;
+	switch(token->kind) {
+	case OPERATOR_PLUS: return "+";
+	case OPERATOR_MINUS: return "-";
+	case OPERATOR_ASTERISK: return "*";
+	default: return 0;
+	}
+	
+}
+
+int is_punctuator(struct token* token, int punctuator) {
+	
+	return token->type == TOKEN_PUNCTUATOR && token->kind == punctuator;
+	
+}
+
+void append_literal_token(struct buffer* out, struct token* token) {
+	
+	buffer_append_unsigned(out, token->value);
+	buffer_append_string(out, token->kind == LITERAL_64 ? "L" : token->kind == LITERAL_64_UNSIGNED ? "UL" : "");
+	
+}
+
+void append_int32(struct buffer* out, int32_t value) { // the way the generator prints a folded int
+	
+	if(value >= 0) buffer_append_unsigned(out, value);
+	else if(value == INT32_MIN) buffer_append_string(out, "(-2147483647-1)");
+	else {
+		buffer_append_string(out, "(-");
+		buffer_append_unsigned(out, -(int64_t)value);
+		buffer_append_char(out, ')');
+	}
+	
+}
+
+// The workloads only have int literals, and int arithmetic that wraps is what optimize() folds them to.
+uint32_t apply(uint32_t a, const char* operator, uint32_t b) {
+	
+	return *operator == '+' ? a + b : *operator == '-' ? a - b : a * b;
+	
+}
+
+// tokens starts at the function's "fn". chain is lit (op lit)*, which is left-associative, deep is
+// lit * (lit * (... lit)), which nests to the right. Both are rebuilt with loops.
+int expected_function(struct token* tokens, const char* source, enum workload kind, struct buffer* plain, struct buffer* folded) {
+	
+	struct token* name = &tokens[1];
+	struct token* t = &tokens[7]; // after fn name ( ) -> i32 {
+	if(t->type != TOKEN_KEYWORD || t->kind != KEYWORD_RETURN) return -1;
+	t++;
+	
+	buffer_append_string(plain, "i32 ");
+	buffer_append(plain, &source[name->offset], name->length);
+	buffer_append_string(plain, "(){\nreturn ");
+	buffer_append(folded, plain->data, plain->size);
+	
+	struct buffer expression = {0};
+	uint32_t value;
+	size_t terms = 1;
+	if(kind == WORKLOAD_CHAIN) {
+		if(t->type != TOKEN_INTEGER_LITERAL) return -1;
+		append_literal_token(&expression, t);
+		value = t->value;
+		for(t++; binary_operator(t); t += 2) {
+			if(t[1].type != TOKEN_INTEGER_LITERAL) return -1;
+			buffer_append_string(&expression, binary_operator(t));
+			append_literal_token(&expression, &t[1]);
+			buffer_append_char(&expression, ')');
+			value = apply(value, binary_operator(t), t[1].value);
+			terms++;
+		}
+		for(size_t i = 1; i < terms; i++) buffer_append_char(plain, '(');
+	} else {
+		value = 1;
+		for(; t->type == TOKEN_INTEGER_LITERAL && binary_operator(&t[1]) && is_punctuator(&t[2], PUNCTUATOR_OPEN_PAREN); t += 3) {
+			buffer_append_char(&expression, '(');
+			append_literal_token(&expression, t);
+			buffer_append_string(&expression, binary_operator(&t[1]));
+			value = apply(value, "*", t->value);
+			terms++;
+		}
+		if(t->type != TOKEN_INTEGER_LITERAL) return -1;
+		append_literal_token(&expression, t);
+		value = apply(value, "*", t->value);
+		for(size_t i = 1; i < terms; i++) {
+			t++;
+			if(!is_punctuator(t, PUNCTUATOR_CLOSE_PAREN)) return -1;
+			buffer_append_char(&expression, ')'); // the parser keeps no parentheses, the generator adds its own
+		}
+		t++;
+	}
+	if(!is_punctuator(t, PUNCTUATOR_SEMICOLON) || terms != STRESS_TERMS) return -1;
+	
+	buffer_append(plain, expression.data, expression.size);
+	buffer_append_string(plain, ";\n}i32 main(){\nreturn 0;\n}");
+	append_int32(folded, value);
+	buffer_append_string(folded, ";\n}i32 main(){\nreturn 0;\n}");
+	buffer_free(&expression);
+	return 0;
+	
+}
+
+int compare(const char* what, struct buffer* expected, struct buffer* actual) {
+	
+	if(actual->size < expected->size) {
+		fprintf(stderr, "%s: the generated C is shorter than the expected one\n", what);
+		return 1;
+	}
+	size_t prelude = actual->size - expected->size; // the typedefs aren't compared
+	if(!memcmp(actual->data + prelude, expected->data, expected->size)) return 0;
+	
+	size_t i = 0;
+	while(i < expected->size && prelude + i < actual->size && actual->data[prelude + i] == expected->data[i]) i++;
+	fprintf(stderr, "%s: the generated C differs from the expected one after %zu bytes of the program\n", what, i);
+	return 1;
+	
+}
+
+int main(int argc, char** argv) {
+	
+	int kind = argc == 2 ? find_workload(argv[1]) : -1;
+	if(kind != WORKLOAD_CHAIN && kind != WORKLOAD_DEEP) {
+		fprintf(stderr, "Usage: stress chain|deep\n");
+		return 1;
+	}
+	
+	struct buffer source = {0};
+	generate_workload(&source, kind, 1, 1); // one function and main
+	buffer_append_char(&source, 0);
+	
+	struct source_file file = {0};
+	file.path = "<workload>";
+	file.source.data = source.data;
+	file.source.size = source.size - 1;
+	tokenize_files(&file, 1);
+	parse_files(&file, 1);
+	struct ast* ast = merge_files(&file, 1);
+	resolve(ast);
+	
+	struct buffer plain = {0};
+	struct buffer folded = {0};
+	if(expected_function(file.tokens, file.source.data, kind, &plain, &folded)) {
+		fprintf(stderr, "The %s workload doesn't have the expected form!\n", argv[1]);
+		return 1;
+	}
+	
+	int failed = 0;
+	struct buffer out = {0};
+	generate_c(ast, &out, LINKAGE_EXTERNAL);
+	failed |= compare("unoptimized", &plain, &out);
+	
+	optimize(ast);
+	out.size = 0;
+	generate_c(ast, &out, LINKAGE_EXTERNAL);
+	failed |= compare("optimized", &folded, &out);
+	
+	buffer_free(&out);
+	buffer_free(&plain);
+	buffer_free(&folded);
+	free_files(&file, 1);
+	return failed;
+	
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Compiles the chain and deep workloads, STRESS_TERMS terms in one expression, with a stack far too small for
+# recursion over it: test/stress compares the generated C to the expected one, caro --run takes the whole way
+# through the compiler. Run through "make test".
+cd "$(dirname "$0")/.." || exit 1
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+report() { # status name
+	if [ "$1" = 0 ]; then
+		echo "PASS stress $2"
+	else
+		echo "FAIL stress $2"
+		cat "$tmp/errors"
+		failed=1
+	fi
+}
+
+for workload in chain deep; do
+	(ulimit -s 256 && ./test/stress "$workload") > "$tmp/errors" 2>&1
+	report $? "$workload (generated C)"
+	./bench/gen "$workload" 1 > "$tmp/source.caro"
+	(ulimit -s 256 && ./caro --run "$tmp/source.caro") > "$tmp/errors" 2>&1
+	report $? "$workload (caro --run)"
+done
+
+exit $failed
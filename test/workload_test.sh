@@ -0,0 +1,22 @@
+#!/bin/sh
+# Every bench/gen workload has to be a valid program, or bench measures the front end on input caro rejects. The
+# stress workloads are left to test/stress_test.sh. Run through "make test".
+cd "$(dirname "$0")/.." || exit 1
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+for workload in expressions nested identifiers comments mixed tables; do
+	for seed in 1 2 3; do
+		./bench/gen "$workload" 300000 "$seed" > "$tmp/source.caro"
+		if ./caro --run "$tmp/source.caro" > /dev/null 2> "$tmp/errors" && ! grep -q "^E:" "$tmp/errors"; then
+			echo "PASS workload $workload (seed $seed)"
+		else
+			echo "FAIL workload $workload (seed $seed)"
+			grep "^E:" "$tmp/errors" | head -n 6
+			failed=1
+		fi
+	done
+done
+
+exit $failed